@@ -0,0 +1,80 @@
+/* File: arena.cc
+ * --------------
+ * Implementation of the bump-pointer parse tree arena.
+ */
+
+#include "arena.h"
+#include "utility.h"
+#include <stdlib.h>
+
+// Every allocation is rounded up to this so any node type is aligned.
+static const size_t Alignment = 16;
+
+thread_local Arena *Arena::current = NULL;
+
+static size_t RoundUp(size_t n) {
+    return (n + Alignment - 1) & ~(Alignment - 1);
+}
+
+Arena::Arena(size_t bs) :
+    next(NULL),
+    limit(NULL),
+    blockSize(bs),
+    bytesAllocated(0)
+{
+}
+
+Arena::~Arena() {
+    if (current == this)
+        current = NULL;
+    Release();
+}
+
+void Arena::NewBlock(size_t minSize) {
+    Block b;
+    b.size = minSize > blockSize ? minSize : blockSize;
+    b.start = (char *)malloc(b.size);
+    if (b.start == NULL)
+        Failure("Out of memory allocating %lu byte arena block", (unsigned long)b.size);
+    blocks.push_back(b);
+    next = b.start;
+    limit = b.start + b.size;
+}
+
+void *Arena::Allocate(size_t size) {
+    size = RoundUp(size);
+    if (next == NULL || (size_t)(limit - next) < size)
+        NewBlock(size);
+    void *p = next;
+    next += size;
+    bytesAllocated += size;
+    return p;
+}
+
+void *Arena::Allocate(size_t size, Cleanup cleanup) {
+    void *p = Allocate(size);
+    PendingCleanup c = { cleanup, p };
+    cleanups.push_back(c);
+    return p;
+}
+
+void Arena::Release() {
+    // cleanups run newest first, mirroring construction order
+    for (size_t i = cleanups.size(); i > 0; i--)
+        cleanups[i-1].fn(cleanups[i-1].obj);
+    cleanups.clear();
+
+    for (size_t i = 0; i < blocks.size(); i++)
+        free(blocks[i].start);
+    blocks.clear();
+    next = limit = NULL;
+    bytesAllocated = 0;
+}
+
+bool Arena::Contains(const void *ptr) const {
+    const char *p = (const char *)ptr;
+    for (size_t i = 0; i < blocks.size(); i++)
+        if (p >= blocks[i].start && p < blocks[i].start + blocks[i].size)
+            return true;
+    return false;
+}
@@ -0,0 +1,63 @@
+/**
+ * File: arena.h
+ * -------------
+ * A bump-pointer arena that owns the storage of one compilation's parse
+ * tree. While an arena is installed on a thread with Arena::SetCurrent(),
+ * every Node (and every List the parser builds) that thread creates is
+ * carved out of the arena's blocks instead of the global heap. Nothing is freed piecemeal: once the program
+ * has been emitted the whole tree goes away with a single Release().
+ *
+ * Objects that own heap memory of their own (the deque inside a List)
+ * register a cleanup when they are allocated; Release() runs those before
+ * dropping the blocks. Nodes are never destroyed individually, so they
+ * must not rely on their destructors running.
+ *
+ * When no arena is current (the static Type singletons are built during
+ * static initialization, for example) allocation falls back to the heap.
+ */
+
+#ifndef _H_arena
+#define _H_arena
+
+#include <stddef.h>
+#include <vector>
+
+class Arena {
+  public:
+    typedef void (*Cleanup)(void *obj);
+
+    Arena(size_t blockSize = DefaultBlockSize);
+    ~Arena();
+
+    void *Allocate(size_t size);
+    void *Allocate(size_t size, Cleanup cleanup);
+
+    // Runs registered cleanups and frees every block in one step.
+    void Release();
+
+    bool Contains(const void *ptr) const;
+    size_t BytesAllocated() const { return bytesAllocated; }
+
+    static Arena *Current() { return current; }
+    static void SetCurrent(Arena *a) { current = a; }
+
+    static const size_t DefaultBlockSize = 64 * 1024;
+
+  private:
+    struct Block { char *start; size_t size; };
+    struct PendingCleanup { Cleanup fn; void *obj; };
+
+    std::vector<Block> blocks;
+    std::vector<PendingCleanup> cleanups;
+    char *next, *limit;
+    size_t blockSize, bytesAllocated;
+
+    void NewBlock(size_t minSize);
+
+    static thread_local Arena *current;
+
+    Arena(const Arena &);            // not copyable
+    Arena &operator=(const Arena &);
+};
+
+#endif
@@ -9,23 +9,41 @@
 #include <string.h> // strdup
 #include <stdio.h>  // printf
 #include "irgen.h"
+#include "arena.h"
+#include "timing.h"
 
 Node::Node(yyltype loc) {
-    location = new yyltype(loc);
+    location = loc;
+    hasLocation = true;
     parent = NULL;
 }
 
 Node::Node() {
-    location = NULL;
+    hasLocation = false;
     parent = NULL;
 }
 
-SymbolTable *Node::symTable = new SymbolTable();
-IRGenerator *Node::irgen = new IRGenerator();
+void *Node::operator new(size_t size) {
+    Timing::Count(Timing::AstNodes);
+    if (Arena *arena = Arena::Current())
+        return arena->Allocate(size);
+    return ::operator new(size);
+}
+
+void Node::operator delete(void *p) {
+    // arena storage is only ever reclaimed by Arena::Release()
+    Arena *arena = Arena::Current();
+    if (arena == NULL || !arena->Contains(p))
+        ::operator delete(p);
+}
+
+// Set by CompilationContext::Compile() for the compilation on this thread
+thread_local SymbolTable *Node::symTable = NULL;
+thread_local IRGenerator *Node::irgen = NULL;
 
 //Initialize break and continue statements
-vector<llvm::BasicBlock*> *Node::breakBB = new vector<llvm::BasicBlock*>();
-vector<llvm::BasicBlock*> *Node::continueBB = new vector<llvm::BasicBlock*>();
+thread_local vector<llvm::BasicBlock*> *Node::breakBB = NULL;
+thread_local vector<llvm::BasicBlock*> *Node::continueBB = NULL;
 
 /* The Print method is used to print the parse tree nodes.
  * If this node has a location (most nodes do, but some do not), it
@@ -47,10 +65,14 @@ void Node::Print(int indentLevel, const char *label) {
    PrintChildren(indentLevel);
 } 
 	 
+Identifier::Identifier(yyltype loc, Symbol s) : Node(loc) {
+    sym = s;
+}
+
 Identifier::Identifier(yyltype loc, const char *n) : Node(loc) {
-    name = strdup(n);
+    sym = Interner::Intern(n);
 } 
 
 void Identifier::PrintChildren(int indentLevel) {
-    printf("%s", name);
+    printf("%s", GetName());
 }
@@ -11,6 +11,11 @@
  * file), that location can be NULL for those nodes that don't care/use 
  * locations. The location is typcially set by the node constructor.  The 
  * location is used to provide the context when reporting semantic errors.
+ * It is stored inline in the node rather than in a separate allocation.
+ *
+ * Storage: Nodes are allocated from the current Arena (see arena.h) and
+ * are released all at once after the program has been emitted. They are
+ * never deleted one at a time.
  *
  * Parent: Each node has a pointer to its parent. For a Program node, the 
  * parent is NULL, for all other nodes it is the pointer to the node one level
@@ -39,6 +44,7 @@
 
 #include <stdlib.h>   // for NULL
 #include "location.h"
+#include "intern.h"
 #include <iostream>
 #include "llvm/IR/Value.h"
 #include <vector>
@@ -52,23 +58,29 @@ class IRGenerator;
 
 class Node  {
   protected:
-    yyltype *location;
+    yyltype location;
+    bool hasLocation;
     Node *parent;
 
   public:
-    static SymbolTable *symTable;
-    static IRGenerator *irgen;
+    // These belong to the CompilationContext compiling on this thread,
+    // which points them at its own objects (see context.h).
+    static thread_local SymbolTable *symTable;
+    static thread_local IRGenerator *irgen;
 
     //Declaration for break and continue statements
     //Use vector so we can access methods such as back and push_back for vectors
-    static vector<llvm::BasicBlock*> *breakBB;
-    static vector<llvm::BasicBlock*> *continueBB;
+    static thread_local vector<llvm::BasicBlock*> *breakBB;
+    static thread_local vector<llvm::BasicBlock*> *continueBB;
 
     Node(yyltype loc);
     Node();
     virtual ~Node() {}
+
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
     
-    yyltype *GetLocation()   { return location; }
+    yyltype *GetLocation()   { return hasLocation ? &location : NULL; }
     void SetParent(Node *p)  { parent = p; }
     Node *GetParent()        { return parent; }
 
@@ -79,6 +91,10 @@ class Node  {
     void Print(int indentLevel, const char *label = NULL); 
     virtual void PrintChildren(int indentLevel)  {}
 
+    // Check() annotates the subtree (Expr::type and friends) before any
+    // IR is emitted, so Emit() can dispatch on types without lowering
+    // operands just to look at the llvm::Type they produce.
+    virtual void Check() {}
     virtual llvm::Value* Emit() {return NULL;}
 };
    
@@ -86,14 +102,16 @@ class Node  {
 class Identifier : public Node 
 {
   protected:
-    char *name;
+    Symbol sym;
     
   public:
+    Identifier(yyltype loc, Symbol sym);
     Identifier(yyltype loc, const char *name);
     const char *GetPrintNameForNode()   { return "Identifier"; }
-    char *GetName() const { return name; }
+    Symbol GetSymbol() const { return sym; }
+    const char *GetName() const { return Interner::NameOf(sym); }
     void PrintChildren(int indentLevel);
-    friend ostream& operator<<(ostream& out, Identifier *id) { return out << id->name; }
+    friend ostream& operator<<(ostream& out, Identifier *id) { return out << id->GetName(); }
 };
 
 
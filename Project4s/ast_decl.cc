@@ -9,27 +9,31 @@
 #include "irgen.h"
 const int P = 1;
 const bool F = false;
+
+thread_local int VarDecl::nextGlobalSlot = 0;
+thread_local int VarDecl::nextLocalSlot = 0;
          
 Decl::Decl(Identifier *n) : Node(*n->GetLocation()) {
     Assert(n != NULL);
     (id=n)->SetParent(this); 
 }
 
-VarDecl::VarDecl(Identifier *n, Type *t, Expr *e) : Decl(n) {
+VarDecl::VarDecl(Identifier *n, Type *t, Expr *e)
+  : Decl(n), type(NULL), typeq(NULL), assignTo(NULL), slot(-1), global(F) {
     Assert(n != NULL && t != NULL);
     (type=t)->SetParent(this);
     if (e) (assignTo=e)->SetParent(this);
-    typeq = NULL;
 }
 
-VarDecl::VarDecl(Identifier *n, TypeQualifier *tq, Expr *e) : Decl(n) {
+VarDecl::VarDecl(Identifier *n, TypeQualifier *tq, Expr *e)
+  : Decl(n), type(NULL), typeq(NULL), assignTo(NULL), slot(-1), global(F) {
     Assert(n != NULL && tq != NULL);
     (typeq=tq)->SetParent(this);
     if (e) (assignTo=e)->SetParent(this);
-    type = NULL;
 }
 
-VarDecl::VarDecl(Identifier *n, Type *t, TypeQualifier *tq, Expr *e) : Decl(n) {
+VarDecl::VarDecl(Identifier *n, Type *t, TypeQualifier *tq, Expr *e)
+  : Decl(n), type(NULL), typeq(NULL), assignTo(NULL), slot(-1), global(F) {
     Assert(n != NULL && t != NULL && tq != NULL);
     (type=t)->SetParent(this);
     (typeq=tq)->SetParent(this);
@@ -43,31 +47,46 @@ void VarDecl::PrintChildren(int indentLevel) {
    if (assignTo) assignTo->Print(indentLevel+P, "(initializer) ");
 }
 
+void VarDecl::Check() {
+    if (assignTo) assignTo->Check();
+
+    // variables declared in the outermost scope live in the module, all
+    // others in their function's frame
+    global = (symTable->current == P);
+    slot = global ? nextGlobalSlot++ : nextLocalSlot++;
+
+    values in;
+    in.value = NULL;
+    in.decl = this;
+    in.flag = global ? P : 0;
+    symTable->addSym(make_pair(id->GetSymbol(), in));
+}
+
 llvm::Value* VarDecl::Emit() {
     llvm::Twine *vName = new llvm::Twine(this->id->GetName());
     llvm::Type *type = IRGenerator::convertType(this->GetType(), irgen->GetContext());
-    values in;
+    llvm::Value *storage;
 
-    if (symTable->current != P) {
-        llvm::BasicBlock *bb = irgen->GetBasicBlock();
-        llvm::Value *val = new llvm::AllocaInst( IRGenerator::convertType(this->GetType(), irgen->GetContext()), *vName, bb);
-        in.value = val;
-        in.decl = this;
-        in.flag = 0;
-   }
-    
-     if (symTable->current == P){
-        llvm::GlobalVariable *gvar = new llvm::GlobalVariable(
-            *irgen->GetOrCreateModule("module.bc"),  IRGenerator::convertType(this->GetType(), irgen->GetContext()), F, llvm::GlobalValue::ExternalLinkage, llvm::Constant::getNullValue( IRGenerator::convertType(this->GetType(), irgen->GetContext())), *vName);
-        in.value = gvar;
-        in.decl = this;
-        in.flag = P;  
-     } 
-    symTable->addSym(make_pair(getId(), in));
+    if (!global) {
+        storage = irgen->CreateEntryAlloca(type, *vName);
+    }
+    else {
+        storage = new llvm::GlobalVariable(
+            *irgen->GetOrCreateModule("module.bc"), type, F, llvm::GlobalValue::ExternalLinkage, llvm::Constant::getNullValue(type), *vName);
+    }
+    irgen->SetSlot(global, slot, storage);
     return NULL;
 }
 
-FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl*> *d) : Decl(n) {
+void VarDecl::EmitExternal() {
+    Assert(global);
+    llvm::Type *type = IRGenerator::convertType(this->GetType(), irgen->GetContext());
+    llvm::Value *storage = new llvm::GlobalVariable(
+        *irgen->GetOrCreateModule("module.bc"), type, F, llvm::GlobalValue::ExternalLinkage, NULL, this->id->GetName());
+    irgen->SetSlot(true, slot, storage);
+}
+
+FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl*> *d) : Decl(n), numLocals(0) {
     Assert(n != NULL && r!= NULL && d != NULL);
     (returnType=r)->SetParent(this);
     (formals=d)->SetParentAll(this);
@@ -75,7 +94,7 @@ FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl*> *d) : Decl(n) {
     returnTypeq = NULL;
 }
 
-FnDecl::FnDecl(Identifier *n, Type *r, TypeQualifier *rq, List<VarDecl*> *d) : Decl(n) {
+FnDecl::FnDecl(Identifier *n, Type *r, TypeQualifier *rq, List<VarDecl*> *d) : Decl(n), numLocals(0) {
     Assert(n != NULL && r != NULL && rq != NULL&& d != NULL);
     (returnType=r)->SetParent(this);
     (returnTypeq=rq)->SetParent(this);
@@ -95,8 +114,30 @@ void FnDecl::PrintChildren(int indentLevel) {
 }
 
 
-llvm::Value* FnDecl::Emit() {
+void FnDecl::Check() {
+    // the function goes into the enclosing scope first so that calls in
+    // its own body (and in later functions) resolve to it
+    values in;
+    in.value = NULL;
+    in.decl = this;
+    in.flag = P;
+    symTable->addSym(make_pair(id->GetSymbol(), in));
+
     symTable->push();
+    VarDecl::nextLocalSlot = 0;
+    for (int i = 0; i < formals->NumElements(); i++)
+        formals->Nth(i)->Check();
+    if (body) body->Check();
+    numLocals = VarDecl::nextLocalSlot;
+    symTable->pop();
+}
+
+void FnDecl::Fold() {
+    if (body) (body=body->Fold())->SetParent(this);
+}
+
+llvm::Value* FnDecl::Emit() {
+    irgen->ResetLocalSlots(numLocals);
     vector<llvm::Type*> vType;
     llvm::Type *ty = IRGenerator::convertType(returnType, irgen->GetContext());
     int i = 0;
@@ -111,6 +152,9 @@ llvm::Value* FnDecl::Emit() {
     llvm::FunctionType *funcType = llvm::FunctionType::get(ty, arrayV, F);    
     irgen->SetFunction(llvm::cast<llvm::Function>(
         irgen->GetOrCreateModule("foo.bc")->getOrInsertFunction(llvm::StringRef(this->id->GetName()), funcType)));
+    int lanes = returnType->NumComponents();
+    if ((returnType->IsVector() || returnType->IsMatrix()) && IRGenerator::PaddedLanes(lanes) != lanes)
+        irgen->GetFunction()->addFnAttr(IRGenerator::ResultLanesAttr, std::to_string(lanes));
     const llvm::Twine* name = new llvm::Twine(this->id->GetName());
     llvm::BasicBlock *basicBlock = llvm::BasicBlock::Create( *irgen->GetContext(), *name, llvm::cast<llvm::Function>(
         irgen->GetOrCreateModule("foo.bc")->getOrInsertFunction(llvm::StringRef(this->id->GetName()), funcType)));
@@ -120,16 +164,15 @@ llvm::Value* FnDecl::Emit() {
         irgen->GetOrCreateModule("foo.bc")->getOrInsertFunction(llvm::StringRef(this->id->GetName()), funcType))->arg_begin();
     while ( iter != llvm::cast<llvm::Function>(
         irgen->GetOrCreateModule("foo.bc")->getOrInsertFunction(llvm::StringRef(this->id->GetName()), funcType))->arg_end()) {
-        formals->Nth(i)->Emit();
-        iter->setName( formals->Nth(i)->getId());
-        values in = symTable->lookupValue( formals->Nth(i)->getId());
-        new llvm::StoreInst((&*iter), in.value, basicBlock);
+        VarDecl *formal = formals->Nth(j);
+        formal->Emit();
+        iter->setName(formal->getId());
+        new llvm::StoreInst((&*iter), irgen->GetSlot(F, formal->GetSlot()), basicBlock);
 	iter++;
 	j++;
     }
 
     body->Emit();
-    symTable->pop();
 
     return NULL;
 } 
@@ -45,16 +45,29 @@ class VarDecl : public Decl
     Type *type;
     TypeQualifier *typeq;
     Expr *assignTo;
+    int slot;     // storage index assigned by Check()
+    bool global;  // slot is in the module's globals, not the function's
     
   public:
-    VarDecl() : type(NULL), typeq(NULL), assignTo(NULL) {}
+    VarDecl() : type(NULL), typeq(NULL), assignTo(NULL), slot(-1), global(false) {}
     VarDecl(Identifier *name, Type *type, Expr *assignTo = NULL);
     VarDecl(Identifier *name, TypeQualifier *typeq, Expr *assignTo = NULL);
     VarDecl(Identifier *name, Type *type, TypeQualifier *typeq, Expr *assignTo = NULL);
     const char *GetPrintNameForNode() { return "VarDecl"; }
     void PrintChildren(int indentLevel);
     Type *GetType() const { return type; }
+    int GetSlot() const { return slot; }
+    bool IsGlobal() const { return global; }
+    void Check();
     llvm::Value* Emit();
+
+    // Declares this global without defining it, in a module of its own
+    // that will be linked against the one holding the definition.
+    void EmitExternal();
+
+    // Next free slot numbers while checking; Program::Check and
+    // FnDecl::Check reset them so rechecking a tree gives the same slots.
+    static thread_local int nextGlobalSlot, nextLocalSlot;
 };
 
 class VarDeclError : public VarDecl
@@ -71,9 +84,10 @@ class FnDecl : public Decl
     Type *returnType;
     TypeQualifier *returnTypeq;
     Stmt *body;
+    int numLocals;  // local slots used by formals and body
     
   public:
-    FnDecl() : Decl(), formals(NULL), returnType(NULL), returnTypeq(NULL), body(NULL) {}
+    FnDecl() : Decl(), formals(NULL), returnType(NULL), returnTypeq(NULL), body(NULL), numLocals(0) {}
     FnDecl(Identifier *name, Type *returnType, List<VarDecl*> *formals);
     FnDecl(Identifier *name, Type *returnType, TypeQualifier *returnTypeq, List<VarDecl*> *formals);
     void SetFunctionBody(Stmt *b);
@@ -82,6 +96,8 @@ class FnDecl : public Decl
 
     Type *GetType() const { return returnType; }
     List<VarDecl*> *GetFormals() {return formals;}
+    void Check();
+    void Fold();
     llvm::Value* Emit();
 };
 
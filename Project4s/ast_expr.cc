@@ -4,19 +4,52 @@
  */
 
 #include <string.h>
+#include <limits.h>
 #include "ast_expr.h"
 #include "ast_type.h"
 #include "ast_decl.h"
 #include "symtable.h"
+#include "errors.h"
+#include "llvm/IR/Intrinsics.h"
 const int T = 1;
 const int ZERO = 0;
 
+thread_local int Expr::numNodes = 0;
+thread_local int Expr::numLowered = 0;
+thread_local int Expr::numReused = 0;
+thread_local int Expr::emitEpoch = 0;
+thread_local int Expr::numFolded = 0;
+
+/* Expr::EmitValue
+ * ---------------
+ * An operand asked for again from the block its first lowering ended in
+ * hands back the same llvm::Value, so a parent that needs both the type
+ * and the value of a child (or needs it on several paths) no longer
+ * re-emits the whole subtree each time. Lowering from any other block is
+ * a new evaluation point and emits fresh IR there.
+ */
+llvm::Value* Expr::EmitValue() {
+    if (emitted != NULL && emittedEpoch == emitEpoch &&
+        emittedBB == irgen->GetBasicBlock()) {
+        numReused++;
+        return emitted;
+    }
+    numLowered++;
+    emitted = Emit();
+    emittedBB = irgen->GetBasicBlock();
+    emittedEpoch = emitEpoch;
+    return emitted;
+}
+
 IntConstant::IntConstant(yyltype loc, int val) : Expr(loc) {
     value = val;
 }
 void IntConstant::PrintChildren(int indentLevel) { 
     printf("%d", value);
 }
+void IntConstant::Check() {
+    type = Type::intType;
+}
 llvm::Value* IntConstant::Emit() {
     return llvm::ConstantInt::get(irgen->GetIntType(), value);
 }
@@ -27,6 +60,9 @@ FloatConstant::FloatConstant(yyltype loc, double val) : Expr(loc) {
 void FloatConstant::PrintChildren(int indentLevel) { 
     printf("%g", value);
 }
+void FloatConstant::Check() {
+    type = Type::floatType;
+}
 llvm::Value* FloatConstant::Emit() {
     return llvm::ConstantFP::get(irgen->GetFloatType(), value);
 }
@@ -37,11 +73,14 @@ BoolConstant::BoolConstant(yyltype loc, bool val) : Expr(loc) {
 void BoolConstant::PrintChildren(int indentLevel) { 
     printf("%s", value ? "true" : "false");
 }
+void BoolConstant::Check() {
+    type = Type::boolType;
+}
 llvm::Value* BoolConstant::Emit() {
     return llvm::ConstantInt::get(irgen->GetBoolType(), value);
 }
 
-VarExpr::VarExpr(yyltype loc, Identifier *ident) : Expr(loc) {
+VarExpr::VarExpr(yyltype loc, Identifier *ident) : Expr(loc), decl(NULL) {
     Assert(ident != NULL);
     this->id = ident;
 }
@@ -50,14 +89,24 @@ void VarExpr::PrintChildren(int indentLevel) {
     id->Print(indentLevel+1);
 }
 
+void VarExpr::Check() {
+    decl = dynamic_cast<VarDecl*>(symTable->lookupValue(id->GetSymbol()).decl);
+    if (decl == NULL) {
+        ReportError::IdentifierNotDeclared(id, LookingForVariable);
+        type = Type::errorType;
+        return;
+    }
+    type = decl->GetType();
+}
+
 llvm::Value* VarExpr::Emit() {
     llvm::Twine *twine = new llvm::Twine(this->id->GetName());
-    llvm::Value *returnV = new llvm::LoadInst( symTable->lookupValue(id->GetName()).value, *twine, irgen->GetBasicBlock());
+    llvm::Value *returnV = new llvm::LoadInst( getValue(), *twine, irgen->GetBasicBlock());
     return returnV; 
 } 
 
 llvm::Value* VarExpr::getValue() {
-    return symTable->lookupValue(id->GetName()).value;
+    return irgen->GetSlot(decl->IsGlobal(), decl->GetSlot());
 }
 
 Operator::Operator(yyltype loc, const char *tok) : Node(loc) {
@@ -102,6 +151,133 @@ void CompoundExpr::PrintChildren(int indentLevel) {
    if (right) right->Print(indentLevel+1);
 }
    
+void CompoundExpr::Check() {
+    if (left) left->Check();
+    if (right) right->Check();
+}
+
+/* Function: ArithmeticResultType
+ * ------------------------------
+ * Result type of a binary arithmetic operator. Operands of the same type
+ * give that type, a scalar combined with a vector or matrix of that
+ * scalar type gives the vector/matrix, and matrix * vector (or vector *
+ * matrix) gives the vector when the vector has as many components as the
+ * matrix has columns. There are no implicit conversions: int + float and
+ * 2 * vec3 are errors, as the IR would need an sitofp the source lacks.
+ */
+static Type *ScalarTypeOf(Type *t) {
+    return t->IsMatrix() ? Type::floatType : t->ComponentType();
+}
+
+static Type *ArithmeticResultType(bool isMul, Type *l, Type *r) {
+    if (l->IsError() || r->IsError()) return Type::errorType;
+    if (!ScalarTypeOf(l)->IsNumeric() || ScalarTypeOf(l) != ScalarTypeOf(r))
+        return Type::errorType;
+    if (l == r) return l;
+    if (l->NumComponents() == 1) return r;
+    if (r->NumComponents() == 1) return l;
+    if (!isMul || l->NumComponents() != r->NumComponents())
+        return Type::errorType;
+    if (l->IsMatrix() && r->IsVector() && r->ComponentType() == Type::floatType) return r;
+    if (l->IsVector() && r->IsMatrix() && l->ComponentType() == Type::floatType) return l;
+    return Type::errorType;
+}
+
+/* ++ and -- load their operand, add one and store back through the
+ * load's address, so the operand must be a plain variable of a numeric
+ * scalar or vector type: not a swizzle (whose value is no load), a bool
+ * or a matrix (which has no "one"). */
+static bool CheckIncrement(Operator *op, Expr *operand) {
+    Type *t = operand->type;
+    if (t->IsError())
+        return false;
+    if (dynamic_cast<VarExpr*>(operand) == NULL ||
+        t->IsMatrix() || !(t->IsVector() ? t->ComponentType() : t)->IsNumeric()) {
+        ReportError::IncompatibleOperand(op, t);
+        return false;
+    }
+    return true;
+}
+
+void ArithmeticExpr::Check() {
+    CompoundExpr::Check();
+    if (left == NULL) {
+        type = right->type;
+        if ((op->IsOp("++") || op->IsOp("--")) && !CheckIncrement(op, right))
+            type = Type::errorType;
+    }
+    else {
+        type = ArithmeticResultType(op->IsOp("*"), left->type, right->type);
+        if (type->IsError() && !left->type->IsError() && !right->type->IsError())
+            ReportError::IncompatibleOperands(op, left->type, right->type);
+    }
+}
+
+void RelationalExpr::Check() {
+    CompoundExpr::Check();
+    type = Type::boolType;
+}
+
+void EqualityExpr::Check() {
+    CompoundExpr::Check();
+    type = Type::boolType;
+}
+
+void LogicalExpr::Check() {
+    CompoundExpr::Check();
+    type = Type::boolType;
+}
+
+/* Function: IsAssignable
+ * ----------------------
+ * Whether e names storage AssignExpr::Emit can write: a variable, or a
+ * swizzle of one (through any number of swizzles) whose lanes are all
+ * different, since v.xx = ... would write one lane twice.
+ */
+static bool IsAssignable(Expr *e) {
+    if (dynamic_cast<VarExpr*>(e) != NULL)
+        return true;
+    FieldAccess *swizzle = dynamic_cast<FieldAccess*>(e);
+    if (swizzle == NULL)
+        return false;
+    vector<int> lanes;
+    if (dynamic_cast<VarExpr*>(swizzle->GetLanes(lanes)) == NULL)
+        return false;
+    for (size_t i = 0; i < lanes.size(); i++)
+        for (size_t j = i + 1; j < lanes.size(); j++)
+            if (lanes[i] == lanes[j])
+                return false;
+    return true;
+}
+
+/* The value stored must have the target's type: for x op= y that is the
+ * type x op y would have, so vec3 += vec2 and m *= v are rejected here
+ * rather than reaching EmitArithmetic with operands it cannot combine. */
+void AssignExpr::Check() {
+    CompoundExpr::Check();
+    type = left->type;
+    if (left->type->IsError() || right->type->IsError())
+        return;
+
+    if (!IsAssignable(left)) {
+        ReportError::Formatted(left->GetLocation(), "Left side of assignment is not assignable");
+        type = Type::errorType;
+        return;
+    }
+    Type *result = right->type;
+    if (!op->IsOp("="))
+        result = ArithmeticResultType(op->IsOp("*="), left->type, right->type);
+    if (result != left->type) {
+        ReportError::IncompatibleOperands(op, left->type, right->type);
+        type = Type::errorType;
+    }
+}
+
+void PostfixExpr::Check() {
+    CompoundExpr::Check();
+    type = CheckIncrement(op, left) ? left->type : Type::errorType;
+}
+
 ConditionalExpr::ConditionalExpr(Expr *c, Expr *t, Expr *f)
   : Expr(Join(c->GetLocation(), f->GetLocation())) {
     Assert(c != NULL && t != NULL && f != NULL);
@@ -115,6 +291,24 @@ void ConditionalExpr::PrintChildren(int indentLevel) {
     trueExpr->Print(indentLevel+1, "(true) ");
     falseExpr->Print(indentLevel+1, "(false) ");
 }
+void ConditionalExpr::Check() {
+    cond->Check();
+    trueExpr->Check();
+    falseExpr->Check();
+    if (!cond->type->IsError() && cond->type != Type::boolType)
+        ReportError::TestNotBoolean(cond);
+
+    Type *t = trueExpr->type, *f = falseExpr->type;
+    if (t->IsError() || f->IsError())
+        type = Type::errorType;
+    else if (t != f) {
+        ReportError::Formatted(GetLocation(), "The arms of ?: must have the same type");
+        type = Type::errorType;
+    }
+    else
+        type = t;
+}
+
 ArrayAccess::ArrayAccess(yyltype loc, Expr *b, Expr *s) : LValue(loc) {
     (base=b)->SetParent(this); 
     (subscript=s)->SetParent(this);
@@ -125,6 +319,18 @@ void ArrayAccess::PrintChildren(int indentLevel) {
     subscript->Print(indentLevel+1, "(subscript) ");
 }
      
+void ArrayAccess::Check() {
+    base->Check();
+    subscript->Check();
+
+    if (ArrayType *at = dynamic_cast<ArrayType*>(base->type))
+        type = at->GetElemType();
+    else if (base->type->IsVector() || base->type->IsMatrix())
+        type = base->type->ComponentType();
+    else
+        type = Type::errorType;
+}
+
 FieldAccess::FieldAccess(Expr *b, Identifier *f) 
   : LValue(b? Join(b->GetLocation(), f->GetLocation()) : *f->GetLocation()) {
     Assert(f != NULL); // b can be be NULL (just means no explicit base)
@@ -139,7 +345,59 @@ void FieldAccess::PrintChildren(int indentLevel) {
     field->Print(indentLevel+1);
 }
 
-Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc)  {
+/* Function: SwizzleLane
+ * ---------------------
+ * The lane a swizzle letter names, in any of the xyzw, rgba and stpq sets,
+ * or -1 for a letter that names none.
+ */
+static int SwizzleLane(char c) {
+    switch (c) {
+      case 'x': case 'r': case 's': return 0;
+      case 'y': case 'g': case 't': return 1;
+      case 'z': case 'b': case 'p': return 2;
+      case 'w': case 'a': case 'q': return 3;
+      default:                      return -1;
+    }
+}
+
+void FieldAccess::Check() {
+    if (base) base->Check();
+    Type *baseType = base ? base->type : Type::errorType;
+
+    if (baseType->IsError()) {
+        type = Type::errorType;
+        return;
+    }
+    if (!baseType->IsVector()) {
+        ReportError::InaccessibleSwizzle(field, base);
+        type = Type::errorType;
+        return;
+    }
+
+    int len = strlen(field->GetName());
+    if (len > 4) {
+        ReportError::OversizedVector(field, base);
+        type = Type::errorType;
+        return;
+    }
+    // every letter must name a lane, and one the base vector has
+    for (int i = 0; i < len; i++) {
+        int lane = SwizzleLane(field->GetName()[i]);
+        if (lane < 0) {
+            ReportError::InvalidSwizzle(field, base);
+            type = Type::errorType;
+            return;
+        }
+        if (lane >= baseType->NumComponents()) {
+            ReportError::SwizzleOutOfBound(field, base);
+            type = Type::errorType;
+            return;
+        }
+    }
+    type = Type::VectorOf(baseType->ComponentType(), len);
+}
+
+Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc), fn(NULL)  {
     Assert(f != NULL && a != NULL); // b can be be NULL (just means no explicit base)
     base = b;
     if (base) base->SetParent(this);
@@ -153,800 +411,739 @@ void Call::PrintChildren(int indentLevel) {
    if (actuals) actuals->PrintAll(indentLevel+1, "(actuals) ");
 }
 
-llvm::Value* ArithmeticExpr::Emit() {
-    Operator *op = this->op;
-    if (this->left == NULL)
-      if(this->right != NULL) {
-        llvm::LoadInst *inst = llvm::cast<llvm::LoadInst>(right->Emit());
-        llvm::Value *loc = inst->getPointerOperand();
-        if (right->Emit()->getType()->isIntegerTy() == true) {
-            if (op->IsOp("++") == true) {
-                llvm::Value *inc = llvm::BinaryOperator::CreateAdd(right->Emit(), llvm::ConstantInt::get( irgen->GetIntType(), T), "int++",irgen->GetBasicBlock());
-               llvm::Value *storeInst = new llvm::StoreInst(inc, loc, irgen->GetBasicBlock());
-	       (void)storeInst;
-                return inc;
-            }
-            if (op->IsOp("--")== true) {
-                llvm::Value *dec = llvm::BinaryOperator::CreateSub(right->Emit(), llvm::ConstantInt::get( irgen->GetIntType(), T), "int--", irgen->GetBasicBlock());
-                llvm::Value *storeInst = new llvm::StoreInst( llvm::BinaryOperator::CreateSub(right->Emit(), llvm::ConstantInt::get( irgen->GetIntType(), T), "int--", irgen->GetBasicBlock()), loc, irgen->GetBasicBlock());
-               (void)storeInst;
-
-	      return dec;
-            }
-        }
-        else if (right->Emit()->getType()->isFloatTy() == true) {
-            if (op->IsOp("++") == true) {
-                llvm::Value *inc = llvm::BinaryOperator::CreateAdd(right->Emit(), llvm::ConstantInt::get( irgen->GetIntType(), T), "float++", irgen->GetBasicBlock());        
-                llvm::Value *storeInst = new llvm::StoreInst(inc, loc, irgen->GetBasicBlock());
-               (void)storeInst;
-
-	      return inc;
-            } 
-
-            if (op->IsOp("--") == true) {
-                llvm::Value *dec = llvm::BinaryOperator::CreateAdd(right->Emit(), llvm::ConstantInt::get( irgen->GetIntType(), T), "float--", irgen->GetBasicBlock());
-                llvm::Value *storeInst = new llvm::StoreInst(dec, loc, irgen->GetBasicBlock());
-               (void)storeInst;
-
-	      return dec;
-            }   
-        }
+void Call::Check() {
+    for (int i = 0; i < actuals->NumElements(); i++)
+        actuals->Nth(i)->Check();
+
+    Decl *decl = symTable->lookupValue(field->GetSymbol()).decl;
+    fn = dynamic_cast<FnDecl*>(decl);
+    if (fn == NULL) {
+        if (decl == NULL)
+            ReportError::IdentifierNotDeclared(field, LookingForFunction);
+        else
+            ReportError::NotAFunction(field);
+        type = Type::errorType;
+        return;
     }
+    type = fn->GetType();
+}
 
-    if (this->left != NULL)
-      if(this->right != NULL) {
-        llvm::Type *rightType = right->Emit()->getType();
-        llvm::Type *leftType = left->Emit()->getType(); 
- 
-        if (leftType->isIntegerTy() || rightType->isIntegerTy()) { 
-             this->type = Type::intType;
-             
-             if (op->IsOp("+") == true) {
-		return llvm::BinaryOperator::CreateAdd(left->Emit(), right->Emit(), "int+",  irgen->GetBasicBlock());
-             }
-
-            else if (op->IsOp("-") == true) {
-              return llvm::BinaryOperator::CreateSub(left->Emit(), right->Emit(), "int-",  irgen->GetBasicBlock());
-            }
-
-            else if (op->IsOp("*") == true ) {
-             return llvm::BinaryOperator::CreateMul(left->Emit(), right->Emit(), "int*",  irgen->GetBasicBlock());
-            }
-
-            else if (op->IsOp("/") == true) {
-             return llvm::BinaryOperator::CreateSDiv(left->Emit(), right->Emit(), "int/",  irgen->GetBasicBlock());
-            }
-        }
-
-        else if (leftType->isFloatTy() || rightType->isFloatTy()) {
-            this->type = Type::floatType;
- 
-            if (op->IsOp("+") == true) {
-             return llvm::BinaryOperator::CreateAdd(left->Emit(), right->Emit(), "float+",  irgen->GetBasicBlock());
-             }
+/* Constant folding
+ * ----------------
+ * Fold() runs between Check() and Emit(). Operators whose operands are
+ * all scalar constants are evaluated here, in the precision the IR would
+ * use (32-bit wrapping ints, single precision floats), and replaced by a
+ * constant; operations with an identity operand (x*1, x/1, x-0, 1*x,
+ * and for integers x+0 and 0+x) are replaced by the other operand when
+ * that does not change the result's type. Integer division by zero and
+ * INT_MIN / -1 are left for run time.
+ *
+ * Only the constants created here are checked; an operand that survives
+ * was checked already, and checking it again would look its names up
+ * after their scopes closed.
+ */
+static yyltype LocationOf(Node *n) {
+    return n->GetLocation() ? *n->GetLocation() : yyltype();
+}
 
-            else if (op->IsOp("-") == true) {
-              return llvm::BinaryOperator::CreateSub(left->Emit(), right->Emit(), "float-",  irgen->GetBasicBlock());
-            }
+static Expr *Folded(Expr *e) {
+    e->Check();
+    Expr::numFolded++;
+    return e;
+}
 
-            else if (op->IsOp("*") == true) {
-          return llvm::BinaryOperator::CreateMul(left->Emit(), right->Emit(), "float*",  irgen->GetBasicBlock());
-            }
+static bool IsScalarConstant(Expr *e, double v) {
+    if (IntConstant *i = dynamic_cast<IntConstant*>(e)) return i->GetValue() == v;
+    if (FloatConstant *f = dynamic_cast<FloatConstant*>(e)) return (float)f->GetValue() == v;
+    return false;
+}
 
-            else if (op->IsOp("/") == true) {
-           return llvm::BinaryOperator::CreateSDiv(left->Emit(), right->Emit(), "float/",  irgen->GetBasicBlock());
-            }
-        }
+static bool FoldInt(char op, int a, int b, int &res) {
+    unsigned ua = a, ub = b;
+    switch (op) {
+      case '+': res = (int)(ua + ub); return true;
+      case '-': res = (int)(ua - ub); return true;
+      case '*': res = (int)(ua * ub); return true;
+      case '/':
+        if (b == ZERO || (a == INT_MIN && b == -1)) return false;
+        res = a / b;
+        return true;
+    }
+    return false;
+}
 
-        else if (this->left->type == Type::vec2Type || this->right->type == Type::vec2Type) {
-            this->type = Type::vec2Type;            
+static bool FoldFloat(char op, float a, float b, float &res) {
+    switch (op) {
+      case '+': res = a + b; return true;
+      case '-': res = a - b; return true;
+      case '*': res = a * b; return true;
+      case '/': res = a / b; return true;
+    }
+    return false;
+}
 
-            if (op->IsOp("+") == true) {
-             return llvm::BinaryOperator::CreateFAdd(left->Emit(), right->Emit(), "vec2Add",  irgen->GetBasicBlock());
-            }
+template <class T> static bool Compare(const char *op, T a, T b) {
+    if (!strcmp(op, "<"))  return a < b;
+    if (!strcmp(op, ">"))  return a > b;
+    if (!strcmp(op, "<=")) return a <= b;
+    if (!strcmp(op, ">=")) return a >= b;
+    if (!strcmp(op, "==")) return a == b;
+    return a != b;
+}
 
-            else if (op->IsOp("-") == true) {
-             return llvm::BinaryOperator::CreateFSub(left->Emit(), right->Emit(), "vec2Sub",  irgen->GetBasicBlock());
-            }
+Expr *CompoundExpr::Fold() {
+    if (left) (left=left->Fold())->SetParent(this);
+    if (right) (right=right->Fold())->SetParent(this);
+    return this;
+}
 
-            else if (op->IsOp("*") == true) {
-             return llvm::BinaryOperator::CreateFMul(left->Emit(), right->Emit(), "vec2Mult",  irgen->GetBasicBlock());
-            }
+Expr *ArithmeticExpr::Fold() {
+    CompoundExpr::Fold();
+    yyltype loc = LocationOf(this);
+    IntConstant *li = dynamic_cast<IntConstant*>(left), *ri = dynamic_cast<IntConstant*>(right);
+    FloatConstant *lf = dynamic_cast<FloatConstant*>(left), *rf = dynamic_cast<FloatConstant*>(right);
 
-            else if (op->IsOp("/")  == true) {
-             return llvm::BinaryOperator::CreateFDiv(left->Emit(), right->Emit(), "vec2Div",  irgen->GetBasicBlock());
-            }
+    if (left == NULL) {
+        if (op->IsOp("+")) {
+            numFolded++;
+            return right;
         }
+        if (op->IsOp("-") && ri)
+            return Folded(new IntConstant(loc, (int)(0u - (unsigned)ri->GetValue())));
+        if (op->IsOp("-") && rf)
+            return Folded(new FloatConstant(loc, -(float)rf->GetValue()));
+        return this;
+    }
 
-        else if (this->left->type == Type::vec3Type || this->right->type == Type::vec3Type) {
-            this->type = Type::vec3Type;
-
-            if (op->IsOp("+") == true) {
-             return llvm::BinaryOperator::CreateFAdd(left->Emit(), right->Emit(), "vec3Add",  irgen->GetBasicBlock());
-            }
-
-            else if (op->IsOp("-") == true) {
-             return llvm::BinaryOperator::CreateFSub(left->Emit(), right->Emit(), "vec3Sub",  irgen->GetBasicBlock());
-            }
+    char o = op->IsOp("+") ? '+' : op->IsOp("-") ? '-' : op->IsOp("*") ? '*' : '/';
+    int ires;
+    float fres;
+    if (li && ri && FoldInt(o, li->GetValue(), ri->GetValue(), ires))
+        return Folded(new IntConstant(loc, ires));
+    if (lf && rf && FoldFloat(o, lf->GetValue(), rf->GetValue(), fres))
+        return Folded(new FloatConstant(loc, fres));
+
+    Expr *keep = NULL;
+    if ((o == '*' || o == '/') && IsScalarConstant(right, 1)) keep = left;
+    else if (o == '*' && IsScalarConstant(left, 1))          keep = right;
+    else if (o == '-' && IsScalarConstant(right, 0))          keep = left;
+    // -0.0 + 0.0 is +0.0, so adding a zero is only an identity for ints
+    else if (o == '+' && type->IsIntegral() && IsScalarConstant(right, 0)) keep = left;
+    else if (o == '+' && type->IsIntegral() && IsScalarConstant(left, 0))  keep = right;
+    if (keep != NULL && keep->type == this->type) {
+        numFolded++;
+        return keep;
+    }
+    return this;
+}
 
-            else if (op->IsOp("*") == true) {
-             return llvm::BinaryOperator::CreateFMul(left->Emit(), right->Emit(), "vec3Mult",  irgen->GetBasicBlock());
-            }
+Expr *RelationalExpr::Fold() {
+    CompoundExpr::Fold();
+    yyltype loc = LocationOf(this);
+    char opName[4];
+    snprintf(opName, sizeof(opName), "%s", op->IsOp("<") ? "<" : op->IsOp(">") ? ">" :
+                                           op->IsOp("<=") ? "<=" : ">=");
+    IntConstant *li = dynamic_cast<IntConstant*>(left), *ri = dynamic_cast<IntConstant*>(right);
+    FloatConstant *lf = dynamic_cast<FloatConstant*>(left), *rf = dynamic_cast<FloatConstant*>(right);
+    if (li && ri)
+        return Folded(new BoolConstant(loc, Compare(opName, li->GetValue(), ri->GetValue())));
+    if (lf && rf)
+        return Folded(new BoolConstant(loc, Compare(opName, (float)lf->GetValue(), (float)rf->GetValue())));
+    return this;
+}
 
-            else if (op->IsOp("/") == true) {
-             return llvm::BinaryOperator::CreateFDiv(left->Emit(), right->Emit(), "vec3Div",  irgen->GetBasicBlock());
-            }
-        }   
+Expr *EqualityExpr::Fold() {
+    CompoundExpr::Fold();
+    yyltype loc = LocationOf(this);
+    const char *opName = op->IsOp("==") ? "==" : "!=";
+    IntConstant *li = dynamic_cast<IntConstant*>(left), *ri = dynamic_cast<IntConstant*>(right);
+    FloatConstant *lf = dynamic_cast<FloatConstant*>(left), *rf = dynamic_cast<FloatConstant*>(right);
+    BoolConstant *lb = dynamic_cast<BoolConstant*>(left), *rb = dynamic_cast<BoolConstant*>(right);
+    if (li && ri)
+        return Folded(new BoolConstant(loc, Compare(opName, li->GetValue(), ri->GetValue())));
+    if (lf && rf)
+        return Folded(new BoolConstant(loc, Compare(opName, (float)lf->GetValue(), (float)rf->GetValue())));
+    if (lb && rb)
+        return Folded(new BoolConstant(loc, Compare(opName, lb->GetValue(), rb->GetValue())));
+    return this;
+}
 
-        else if (this->left->type == Type::vec4Type || this->right->type == Type::vec4Type) {
-            this->type = Type::vec4Type;
+/* A constant left operand decides && and || on its own (the right one is
+ * then never evaluated); a constant right operand that cannot change the
+ * result (x && true, x || false) leaves just x. */
+Expr *LogicalExpr::Fold() {
+    CompoundExpr::Fold();
+    if (left == NULL)
+        return this;
+    bool isAnd = op->IsOp("&&");
+    BoolConstant *lb = dynamic_cast<BoolConstant*>(left), *rb = dynamic_cast<BoolConstant*>(right);
+
+    if (lb != NULL) {
+        numFolded++;
+        return (lb->GetValue() == isAnd) ? right : left;
+    }
+    if (rb != NULL && rb->GetValue() == isAnd) {
+        numFolded++;
+        return left;
+    }
+    return this;
+}
 
-            if (op->IsOp("+") == true) {
-                return llvm::BinaryOperator::CreateFAdd(left->Emit(), right->Emit(), "vec4Add",  irgen->GetBasicBlock());
-            }
+Expr *ConditionalExpr::Fold() {
+    (cond=cond->Fold())->SetParent(this);
+    (trueExpr=trueExpr->Fold())->SetParent(this);
+    (falseExpr=falseExpr->Fold())->SetParent(this);
+    if (BoolConstant *c = dynamic_cast<BoolConstant*>(cond)) {
+        numFolded++;
+        return c->GetValue() ? trueExpr : falseExpr;
+    }
+    return this;
+}
 
-            else if (op->IsOp("-") == true) {
-                return llvm::BinaryOperator::CreateFSub(left->Emit(), right->Emit(), "vec4Sub",  irgen->GetBasicBlock());
-            }
+Expr *ArrayAccess::Fold() {
+    (base=base->Fold())->SetParent(this);
+    (subscript=subscript->Fold())->SetParent(this);
+    return this;
+}
 
-            else if (op->IsOp("*") == true) {
-                return llvm::BinaryOperator::CreateFMul(left->Emit(), right->Emit(), "vec4Mult",  irgen->GetBasicBlock());
-            }
+Expr *FieldAccess::Fold() {
+    if (base) (base=base->Fold())->SetParent(this);
+    return this;
+}
 
-            else if (op->IsOp("/") == true) {
-                return llvm::BinaryOperator::CreateFDiv(left->Emit(), right->Emit(), "vec4Div",  irgen->GetBasicBlock());
-            }
-        }   
+Expr *Call::Fold() {
+    for (int i = 0; i < actuals->NumElements(); i++) {
+        actuals->SetNth(i, actuals->Nth(i)->Fold());
+        actuals->Nth(i)->SetParent(this);
     }
+    return this;
+}
 
-    return NULL;
+/* Function: ArithmeticOpcode
+ * --------------------------
+ * Picks the LLVM opcode for an arithmetic operator applied to values of
+ * the given (checked) type: float based types use the floating point
+ * opcodes, int/bool based ones the integer opcodes and uint division is
+ * unsigned.
+ */
+static llvm::Instruction::BinaryOps ArithmeticOpcode(const char *op, Type *t) {
+    bool isFloat = !t->IsIntegral();
+    switch (op[ZERO]) {
+      case '+': return isFloat ? llvm::Instruction::FAdd : llvm::Instruction::Add;
+      case '-': return isFloat ? llvm::Instruction::FSub : llvm::Instruction::Sub;
+      case '*': return isFloat ? llvm::Instruction::FMul : llvm::Instruction::Mul;
+      default :
+        if (isFloat) return llvm::Instruction::FDiv;
+        return t->ComponentType() == Type::uintType ? llvm::Instruction::UDiv
+                                                    : llvm::Instruction::SDiv;
+    }
+}
 
+/* Function: SplatTo
+ * -----------------
+ * A scalar operand of a vector operation is broadcast to every lane with
+ * an insertelement and a zero-mask shufflevector, so the operation itself
+ * is a single vector instruction. Anything that is already a vector (or
+ * is wanted as a scalar) is returned as is.
+ */
+static llvm::Value *SplatTo(llvm::Value *val, Type *valType, Type *resultType) {
+    if (valType->IsVector() || !resultType->IsVector())
+        return val;
+
+    llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
+    llvm::LLVMContext *c = Node::irgen->GetContext();
+    int lanes = IRGenerator::PaddedLanes(resultType->NumComponents());
+    llvm::Type *vecTy = llvm::VectorType::get(val->getType(), lanes);
+    llvm::Value *zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*c), ZERO);
+    llvm::Value *one = llvm::InsertElementInst::Create(llvm::UndefValue::get(vecTy), val, zero, "", bb);
+    llvm::Constant *mask = llvm::ConstantAggregateZero::get(
+        llvm::VectorType::get(llvm::Type::getInt32Ty(*c), lanes));
+    return new llvm::ShuffleVectorInst(one, llvm::UndefValue::get(vecTy), mask, "splat", bb);
 }
 
-llvm::Value* PostfixExpr::Emit() {
-    llvm::Type* leftType = left->Emit()->getType();
-    Operator *op = this->op;
+/* Constant one of the same shape as val, used by ++ and -- */
+static llvm::Value *OneLike(llvm::Value *val, Type *t) {
+    if (t->IsIntegral())
+        return llvm::ConstantInt::get(val->getType(), T);
+    return llvm::ConstantFP::get(val->getType(), 1.0);
+}
 
-    llvm::LoadInst *inst = llvm::cast<llvm::LoadInst>(left->Emit());
-    llvm::Value *loc = inst->getPointerOperand();
+/* Matrices are arrays of column vectors (see IRGenerator::convertType);
+ * these pick a column out of one and put one back. */
+static llvm::Value *Column(llvm::Value *mat, int j) {
+    return llvm::ExtractValueInst::Create(mat, j, "col", Node::irgen->GetBasicBlock());
+}
 
-    llvm::BasicBlock *bb = irgen->GetBasicBlock();
-    llvm::Type *intType = irgen->GetIntType();
-    llvm::Value *val1 = llvm::ConstantInt::get(intType, 1);
+static llvm::Value *SetColumn(llvm::Value *mat, llvm::Value *col, int j) {
+    return llvm::InsertValueInst::Create(mat, col, j, "", Node::irgen->GetBasicBlock());
+}
 
-    if (leftType->isIntegerTy()) {
-        if (op->IsOp("++") == true) {
-            llvm::Value *increment = llvm::BinaryOperator::CreateAdd(left->Emit(), val1, "intInc", bb);
-            llvm::Value *storeInst = new llvm::StoreInst(increment, loc, bb);
-            (void)storeInst;
+/* Lane i of vec copied to every lane, with one shufflevector */
+static llvm::Value *BroadcastLane(llvm::Value *vec, int i) {
+    llvm::LLVMContext *c = Node::irgen->GetContext();
+    int lanes = vec->getType()->getVectorNumElements();
+    llvm::Constant *mask = llvm::ConstantVector::getSplat(
+        lanes, llvm::ConstantInt::get(llvm::Type::getInt32Ty(*c), i));
+    return new llvm::ShuffleVectorInst(vec, llvm::UndefValue::get(vec->getType()), mask,
+                                       "bcast", Node::irgen->GetBasicBlock());
+}
 
-            return inst;
-        }
+/* a * b + c through llvm.fmuladd, which the backend turns into a single
+ * fused multiply-add where the target has one */
+static llvm::Value *FMulAdd(llvm::Value *a, llvm::Value *b, llvm::Value *c) {
+    llvm::Function *fn = llvm::Intrinsic::getDeclaration(
+        Node::irgen->GetOrCreateModule("mod.bc"), llvm::Intrinsic::fmuladd, a->getType());
+    llvm::Value *args[] = { a, b, c };
+    return llvm::CallInst::Create(fn, args, "", Node::irgen->GetBasicBlock());
+}
 
-        else if (op->IsOp("--") == true) {
-            llvm::Value *decrement = llvm::BinaryOperator::CreateSub(left->Emit(), val1, "intDec", bb);
-            llvm::Value *storeInst = new llvm::StoreInst(decrement, loc, bb);
-            (void)storeInst;
+/* Function: MatrixTimesVector
+ * ---------------------------
+ * m * v is the sum of m's columns scaled by v's components, unrolled into
+ * one multiply and then a fused multiply-add per remaining column:
+ *    r = col0 * v.xxxx;  r = fma(col1, v.yyyy, r);  ...
+ */
+static llvm::Value *MatrixTimesVector(llvm::Value *m, Type *mt, llvm::Value *v) {
+    llvm::Value *r = llvm::BinaryOperator::CreateFMul(
+        Column(m, ZERO), BroadcastLane(v, ZERO), "", Node::irgen->GetBasicBlock());
+    for (int j = 1; j < mt->NumComponents(); j++)
+        r = FMulAdd(Column(m, j), BroadcastLane(v, j), r);
+    return r;
+}
 
-            return inst;
+/* Function: VectorTimesMatrix
+ * ---------------------------
+ * v * m has the dot product of v with each column of m as its components.
+ * Each is one vector multiply and a sum across the real lanes.
+ */
+static llvm::Value *VectorTimesMatrix(llvm::Value *v, llvm::Value *m, Type *mt) {
+    llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
+    int n = mt->NumComponents();
+    llvm::Value *r = llvm::UndefValue::get(v->getType());
+    for (int j = 0; j < n; j++) {
+        llvm::Value *prod = llvm::BinaryOperator::CreateFMul(v, Column(m, j), "", bb);
+        llvm::Value *sum = NULL;
+        for (int i = 0; i < n; i++) {
+            llvm::Value *lane = llvm::ExtractElementInst::Create(
+                prod, llvm::ConstantInt::get(Node::irgen->GetIntType(), i), "", bb);
+            sum = sum ? llvm::BinaryOperator::CreateFAdd(sum, lane, "", bb) : lane;
         }
+        r = llvm::InsertElementInst::Create(
+            r, sum, llvm::ConstantInt::get(Node::irgen->GetIntType(), j), "", bb);
     }
-
-    else if (leftType->isFloatTy()) {
-        if (op->IsOp("++")== true) {
-            llvm::Value *increment = llvm::BinaryOperator::CreateAdd(left->Emit(), val1, "floatInc", bb);
-            llvm::Value *storeInst = new llvm::StoreInst(increment, loc, bb);
-           (void)storeInst;
-
-            return inst;
-        }
-
-	else if (op->IsOp("--")==true) {
-            llvm::Value *decrement = llvm::BinaryOperator::CreateSub(left->Emit(), val1, "floatDec", bb);
-          llvm::Value *storeInst = new llvm::StoreInst(decrement, loc, bb);
-              (void)storeInst;
-
-            return inst;
-        }
-    } 
-    return NULL;
+    return r;
 }
 
+/* a * b column by column: column j of the product is a * (column j of b) */
+static llvm::Value *MatrixTimesMatrix(llvm::Value *a, Type *mt, llvm::Value *b) {
+    llvm::Value *r = llvm::UndefValue::get(a->getType());
+    for (int j = 0; j < mt->NumComponents(); j++)
+        r = SetColumn(r, MatrixTimesVector(a, mt, Column(b, j)), j);
+    return r;
+}
 
-llvm::Value* RelationalExpr::Emit() {
-    llvm::Type* leftType = left->Emit()->getType();
-    llvm::Type* rightType = right->Emit()->getType();
-    Operator *op = this->op;
-
-    if (leftType->isFloatTy() == true) {
-
-        llvm::CmpInst::OtherOps other = llvm::CmpInst::FCmp;
-        llvm::CmpInst::Predicate pred;
-
-        if (op->IsOp(">") == true) 
-          pred = llvm::CmpInst::FCMP_OGT;
-        else if (op->IsOp("<") == true) 
-          pred = llvm::CmpInst::FCMP_OLT;
-        else if (op->IsOp(">=") == true) 
-          pred = llvm::CmpInst::FCMP_OGE;
-        else if (op->IsOp("<=") == true) 
-          pred = llvm::CmpInst::FCMP_OLE;
-        else 
-          pred = llvm::CmpInst::FCMP_OLE;
-
-        llvm::Value* res = llvm::CmpInst::Create(other, pred, left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-        return res;
-    } 
-
-    else if(rightType->isIntegerTy() == true) {
-        llvm::CmpInst::OtherOps other = llvm::CmpInst::ICmp;
-        llvm::CmpInst::Predicate pred;
-
-        if (op->IsOp(">") == true) 
-          pred = llvm::CmpInst::ICMP_SGT;
-        else if (op->IsOp("<")== true) 
-          pred = llvm::CmpInst::ICMP_SLT;
-        else if (op->IsOp(">=") == true) 
-          pred = llvm::CmpInst::ICMP_SGE;
-        else if ( op->IsOp("<=") == true)
-          pred = llvm::CmpInst::ICMP_SLE;    
-        else 
-          pred = llvm::CmpInst::ICMP_SLE;
-
-        llvm::Value* res = llvm::CmpInst::Create(other, pred, left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-        return res;
+/* Function: EmitColumnwise
+ * ------------------------
+ * A component-wise operator on matrices (+, -, / and anything with a
+ * scalar operand) is one vector instruction per column; a scalar operand
+ * is splatted to a column.
+ */
+static llvm::Value *EmitColumnwise(llvm::Instruction::BinaryOps opcode, llvm::Value *lhs, Type *lt,
+                                   llvm::Value *rhs, Type *rt, Type *mt) {
+    llvm::LLVMContext *c = Node::irgen->GetContext();
+    Type *colType = mt->ComponentType();
+    llvm::Value *res = llvm::UndefValue::get(IRGenerator::convertType(mt, c));
+    for (int j = 0; j < mt->NumComponents(); j++) {
+        llvm::Value *l = lt->IsMatrix() ? Column(lhs, j) : SplatTo(lhs, lt, colType);
+        llvm::Value *r = rt->IsMatrix() ? Column(rhs, j) : SplatTo(rhs, rt, colType);
+        res = SetColumn(res, llvm::BinaryOperator::Create(opcode, l, r, "", Node::irgen->GetBasicBlock()), j);
     }
-  return NULL;
+    return res;
 }
 
-llvm::Value* EqualityExpr::Emit() {
-    llvm::Type* rightType = right->Emit()->getType();
-    llvm::Type* leftType = left->Emit()->getType();
-    Operator *op = this->op;
-
-    if (leftType->isIntegerTy() == true) {
-        llvm::CmpInst::OtherOps other = llvm::CmpInst::ICmp;
-        llvm::CmpInst::Predicate pred = llvm::CmpInst::FCMP_FALSE;
-        string str = "";
-
-        if (op->IsOp("==") == true) {
-            pred = llvm::CmpInst::ICMP_EQ;
-            str = "intEq";
-        }
+/* Function: EmitArithmetic
+ * ------------------------
+ * Emits lhs op rhs for one of + - * / on operands of any shape, giving a
+ * value of resultType. * between a matrix and a vector or matrix is the
+ * linear algebra product; everything else is component-wise, with scalar
+ * operands splatted across the vector or matrix.
+ */
+static llvm::Value *EmitArithmetic(const char *op, llvm::Value *lhs, Type *lt,
+                                   llvm::Value *rhs, Type *rt, Type *resultType) {
+    bool lmat = lt->IsMatrix(), rmat = rt->IsMatrix();
+    if (op[ZERO] == '*' && lmat && rmat)
+        return MatrixTimesMatrix(lhs, lt, rhs);
+    if (op[ZERO] == '*' && lmat && rt->IsVector())
+        return MatrixTimesVector(lhs, lt, rhs);
+    if (op[ZERO] == '*' && lt->IsVector() && rmat)
+        return VectorTimesMatrix(lhs, rhs, rt);
+    if (lmat || rmat)
+        return EmitColumnwise(ArithmeticOpcode(op, resultType), lhs, lt, rhs, rt, resultType);
+
+    lhs = SplatTo(lhs, lt, resultType);
+    rhs = SplatTo(rhs, rt, resultType);
+    return llvm::BinaryOperator::Create(ArithmeticOpcode(op, resultType),
+                                        lhs, rhs, "", Node::irgen->GetBasicBlock());
+}
 
-        else if (op->IsOp("!=") == true) {
-            pred = llvm::CmpInst::ICMP_NE;
-            str = "intNotEq";   
+llvm::Value* ArithmeticExpr::Emit() {
+    if (this->left == NULL) {
+        llvm::Value *val = right->EmitValue();
+        llvm::BasicBlock *bb = irgen->GetBasicBlock();
+
+        if (op->IsOp("+"))
+            return val;
+        if (op->IsOp("-")) {
+            if (right->type->IsMatrix())
+                return EmitColumnwise(llvm::Instruction::FSub,
+                                      llvm::ConstantFP::get(irgen->GetFloatType(), -0.0),
+                                      Type::floatType, val, right->type, right->type);
+            if (right->type->IsIntegral())
+                return llvm::BinaryOperator::CreateNeg(val, "neg", bb);
+            return llvm::BinaryOperator::CreateFNeg(val, "neg", bb);
         }
 
-  return llvm::CmpInst::Create(other, pred, left->Emit(), right->Emit(), str, irgen->GetBasicBlock());
+        // ++x and --x store the new value back through the operand's load
+        const char *opName = op->IsOp("++") ? "+" : "-";
+        llvm::Value *res = llvm::BinaryOperator::Create(
+            ArithmeticOpcode(opName, right->type), val, OneLike(val, right->type), "", bb);
+        llvm::Value *loc = llvm::cast<llvm::LoadInst>(val)->getPointerOperand();
+        new llvm::StoreInst(res, loc, bb);
+        return res;
     }
 
-    else if (rightType->isIntegerTy() == true)
-    {
-      llvm::CmpInst::OtherOps other = llvm::CmpInst::ICmp;
-        llvm::CmpInst::Predicate pred = llvm::CmpInst::FCMP_FALSE;
-        string str = "";
+    llvm::Value *lhs = left->EmitValue();
+    llvm::Value *rhs = right->EmitValue();
+    char opName[2] = { '\0', '\0' };
+    if (op->IsOp("+")) opName[ZERO] = '+';
+    else if (op->IsOp("-")) opName[ZERO] = '-';
+    else if (op->IsOp("*")) opName[ZERO] = '*';
+    else if (op->IsOp("/")) opName[ZERO] = '/';
+    else return NULL;
 
-        if (op->IsOp("==") == true) {
-            pred = llvm::CmpInst::ICMP_EQ;
-            str = "intEq";
-        }
+    return EmitArithmetic(opName, lhs, left->type, rhs, right->type, this->type);
+}
 
-        else if (op->IsOp("!=") == true) {
-            pred = llvm::CmpInst::ICMP_NE;
-            str = "intNotEq";   
-        }
+llvm::Value* PostfixExpr::Emit() {
+    llvm::Value *val = left->EmitValue();
+    llvm::BasicBlock *bb = irgen->GetBasicBlock();
 
-    return llvm::CmpInst::Create(other, pred, left->Emit(), right->Emit(), str, irgen->GetBasicBlock());
-    
-    }
+    const char *opName = op->IsOp("++") ? "+" : "-";
+    llvm::Value *res = llvm::BinaryOperator::Create(
+        ArithmeticOpcode(opName, left->type), val, OneLike(val, left->type), "", bb);
+    llvm::Value *loc = llvm::cast<llvm::LoadInst>(val)->getPointerOperand();
+    new llvm::StoreInst(res, loc, bb);
 
-    else if (leftType->isFloatTy() == true) {
-        llvm::CmpInst::OtherOps other = llvm::FCmpInst::FCmp;
-        llvm::CmpInst::Predicate pred = llvm::CmpInst::FCMP_FALSE;
-        string str = "";
+    // the expression's value is the operand before the update
+    return val;
+}
 
-        if (op->IsOp("==") == true) {
-            pred = llvm::FCmpInst::FCMP_OEQ;
-            str = "floatEq";
-        }
 
-        else if (op->IsOp("!=") == true) {
-            pred = llvm::FCmpInst::FCMP_ONE;
-            str = "floatNotEq";
-        }
+llvm::Value* RelationalExpr::Emit() {
+    llvm::Value *lhs = left->EmitValue();
+    llvm::Value *rhs = right->EmitValue();
+    llvm::CmpInst::Predicate pred;
+
+    if (left->type->IsIntegral()) {
+        bool isUnsigned = left->type == Type::uintType;
+
+        if (op->IsOp(">")) 
+          pred = isUnsigned ? llvm::CmpInst::ICMP_UGT : llvm::CmpInst::ICMP_SGT;
+        else if (op->IsOp("<")) 
+          pred = isUnsigned ? llvm::CmpInst::ICMP_ULT : llvm::CmpInst::ICMP_SLT;
+        else if (op->IsOp(">=")) 
+          pred = isUnsigned ? llvm::CmpInst::ICMP_UGE : llvm::CmpInst::ICMP_SGE;
+        else 
+          pred = isUnsigned ? llvm::CmpInst::ICMP_ULE : llvm::CmpInst::ICMP_SLE;
 
-        llvm::Value* res = llvm::CmpInst::Create(other, pred, left->Emit(), right->Emit(), str, irgen->GetBasicBlock());
-        return res;
+        return llvm::CmpInst::Create(llvm::CmpInst::ICmp, pred, lhs, rhs, "", irgen->GetBasicBlock());
     }
-    else if (rightType->isFloatTy() == true)
-    {
-         llvm::CmpInst::OtherOps other = llvm::FCmpInst::FCmp;
-        llvm::CmpInst::Predicate pred = llvm::CmpInst::FCMP_FALSE;
-        string str = "";
-
-        if (op->IsOp("==") == true) {
-            pred = llvm::FCmpInst::FCMP_OEQ;
-            str = "floatEq";
-        }
 
-        else if (op->IsOp("!=") == true) {
-            pred = llvm::FCmpInst::FCMP_ONE;
-            str = "floatNotEq";
-        }
+    if (op->IsOp(">")) 
+      pred = llvm::CmpInst::FCMP_OGT;
+    else if (op->IsOp("<")) 
+      pred = llvm::CmpInst::FCMP_OLT;
+    else if (op->IsOp(">=")) 
+      pred = llvm::CmpInst::FCMP_OGE;
+    else 
+      pred = llvm::CmpInst::FCMP_OLE;
 
-        llvm::Value* res = llvm::CmpInst::Create(other, pred, left->Emit(), right->Emit(), str, irgen->GetBasicBlock());
-        return res;
+    return llvm::CmpInst::Create(llvm::CmpInst::FCmp, pred, lhs, rhs, "", irgen->GetBasicBlock());
+}
 
-    
-    
-    
+/* Function: ReduceLanes
+ * ---------------------
+ * Vector == and != compare every lane at once; the bool result is the
+ * AND (for ==) or OR (for !=) of the lanes the vector really has, which
+ * leaves out the pad lane of a 3-component vector.
+ */
+static llvm::Value *ReduceLanes(llvm::Value *cmp, Type *t, bool isEq) {
+    llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
+    llvm::Value *res = NULL;
+    for (int i = 0; i < t->NumComponents(); i++) {
+        llvm::Value *lane = llvm::ExtractElementInst::Create(
+            cmp, llvm::ConstantInt::get(Node::irgen->GetIntType(), i), "", bb);
+        if (res == NULL)
+            res = lane;
+        else if (isEq)
+            res = llvm::BinaryOperator::CreateAnd(res, lane, "", bb);
+        else
+            res = llvm::BinaryOperator::CreateOr(res, lane, "", bb);
     }
-    return NULL;
+    return res;
 }
 
-llvm::Value* LogicalExpr::Emit() {
-    Operator* op = this->op;
+llvm::Value* EqualityExpr::Emit() {
+    llvm::Value *lhs = left->EmitValue();
+    llvm::Value *rhs = right->EmitValue();
+    bool isEq = op->IsOp("==");
+    llvm::Value *cmp;
+
+    if (left->type->IsMatrix()) {
+        // column by column, combined the same way as the lanes
+        Type *colType = left->type->ComponentType();
+        llvm::CmpInst::Predicate pred = isEq ? llvm::CmpInst::FCMP_OEQ : llvm::CmpInst::FCMP_ONE;
+        llvm::Value *res = NULL;
+        for (int j = 0; j < left->type->NumComponents(); j++) {
+            cmp = llvm::CmpInst::Create(llvm::CmpInst::FCmp, pred, Column(lhs, j), Column(rhs, j),
+                                        "", irgen->GetBasicBlock());
+            llvm::Value *col = ReduceLanes(cmp, colType, isEq);
+            if (res == NULL)
+                res = col;
+            else if (isEq)
+                res = llvm::BinaryOperator::CreateAnd(res, col, "", irgen->GetBasicBlock());
+            else
+                res = llvm::BinaryOperator::CreateOr(res, col, "", irgen->GetBasicBlock());
+        }
+        return res;
+    }
 
-    if (op->IsOp("||") == true) {
-      return llvm::BinaryOperator::CreateOr(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
+    if (left->type->IsIntegral()) {
+        llvm::CmpInst::Predicate pred = isEq ? llvm::CmpInst::ICMP_EQ : llvm::CmpInst::ICMP_NE;
+        cmp = llvm::CmpInst::Create(llvm::CmpInst::ICmp, pred, lhs, rhs,
+                                    isEq ? "intEq" : "intNotEq", irgen->GetBasicBlock());
     }
-    else if (op->IsOp("&&") == true) {
-      return  llvm::BinaryOperator::CreateAnd(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
+    else {
+        llvm::CmpInst::Predicate pred = isEq ? llvm::CmpInst::FCMP_OEQ : llvm::CmpInst::FCMP_ONE;
+        cmp = llvm::CmpInst::Create(llvm::CmpInst::FCmp, pred, lhs, rhs,
+                                    isEq ? "floatEq" : "floatNotEq", irgen->GetBasicBlock());
     }
-    
 
-    return NULL;
+    if (left->type->IsVector())
+        return ReduceLanes(cmp, left->type, isEq);
+    return cmp;
 }
 
-llvm::Value* AssignExpr::Emit() {
-    llvm::Value* lhs;
-    llvm::Value* lhsVal;
-    const char* swizzle = "";
-
-    if (VarExpr* lhv = dynamic_cast<VarExpr*>(left)) 
-        lhsVal = lhv->getValue();
-    else if (FieldAccess *field = dynamic_cast<FieldAccess*>(left)) {
-        lhsVal = field->getValue();
-        swizzle = field->getFieldId()->GetName();
+/* Operands costing more than this together are not worth evaluating on
+ * both paths to save a branch. */
+static const int MaxSelectCost = 4;
+
+/* Arithmetic, comparisons and logic over operands that are safe to
+ * speculate are as well, except integer division, which traps on zero,
+ * and ++/--, which write their operand. */
+int CompoundExpr::SpeculationCost() {
+    if (op->IsOp("++") || op->IsOp("--"))
+        return -1;
+    if ((op->IsOp("/") || op->IsOp("%")) && type->IsIntegral())
+        return -1;
+    int cost = right->SpeculationCost();
+    if (left != NULL && cost >= 0) {
+        int lcost = left->SpeculationCost();
+        cost = (lcost < 0) ? -1 : cost + lcost;
     }
-    else 
-        lhsVal = right->Emit();
-
-    if (llvm::StoreInst* storeInst = dynamic_cast<llvm::StoreInst*>(right->Emit())) {
-        lhs = storeInst->getValueOperand();
-    }
-
-    llvm::Type* leftType;
-    llvm::Type* rightType = right->Emit()->getType();
-    Operator * op = this->op;
-    int lenght = strlen(swizzle);
-
-    if (op->IsOp("=") == true) {
-        if (lenght != ZERO) {
-            llvm::Value* baseAdd = new llvm::LoadInst(lhsVal, "", irgen->GetBasicBlock());
-            llvm::Constant* id;
-
-            if (rightType->isVectorTy() == true) {
-	     int i = ZERO;
-                while ( i < lenght) {
-                    char c = swizzle[i];
-                    switch(c){
-                    case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                    case 'y':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                    case 'z':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                    default :
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                    }
-                    llvm::Constant* idx = llvm::ConstantInt::get(irgen->GetIntType(), i);
-                    llvm::Value* extract = llvm::ExtractElementInst::Create(right->Emit(), idx, "", irgen->GetBasicBlock());
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, extract, id, "", irgen->GetBasicBlock());
-		    i++;
-                }
-            }
-
-            else if (rightType->isFloatTy() == true) {
-	      int i = ZERO;
-                while ( i < lenght) {
-                    char c = swizzle[i];
-                    switch(c)
-		    {
-                    case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                    case 'y': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                    case 'z':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                    default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                   }
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, right->Emit(), id, "", irgen->GetBasicBlock());
-		    i = i+1;
-                }
-            }
-
-            llvm::Value* res = new llvm::StoreInst(baseAdd, lhsVal, "", irgen->GetBasicBlock());
-            (void) res;
-	    return right->Emit();
-        }
-
-        llvm::Value* res = new llvm::StoreInst(right->Emit(), lhsVal, irgen->GetBasicBlock());
-        (void) res;
-	return right->Emit();
-    }
-
-    else if (op->IsOp("+=") == true) {
-        if(lenght != ZERO) {
-            llvm::Value* baseAdd = new llvm::LoadInst(lhsVal, "", irgen->GetBasicBlock());
-            llvm::Constant* id;
-
-            if (rightType->isVectorTy() == true) {
-	        int i = 0;
-                while ( i < lenght) {
-                    char c = swizzle[i];
-                    switch (c){
-                     case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                     case 'y':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                     case 'z':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                     default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                    }
-                    llvm::Constant* idx = llvm::ConstantInt::get(irgen->GetIntType(), i);
-                    llvm::Value* extractrhs = llvm::ExtractElementInst::Create(right->Emit(), idx, "", irgen->GetBasicBlock());
-                    llvm::Value* extractlhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFAdd(extractlhs, extractrhs, "", irgen->GetBasicBlock());
-
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    i++;
-                }
-            }
-
-            else if (rightType->isFloatTy()) {
-	       int i = ZERO;
-                while ( i < lenght) {
-                    char c = swizzle[i];
-                    switch (c){
-                     case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                     case 'y': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                     case 'z': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                     default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                    }
-                    llvm::Value* extractlhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFAdd(extractlhs, right->Emit(), "", irgen->GetBasicBlock());
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    i++;
-                }
-
-                llvm::Value* res = new llvm::StoreInst(baseAdd, lhsVal, "", irgen->GetBasicBlock());
-               (void) res;
-	       return right->Emit();
-            }
-        }
+    return (cost < 0) ? -1 : cost + 1;
+}
 
-        lhs = left->Emit();
-        leftType = left->Emit()->getType();
+int ConditionalExpr::SpeculationCost() {
+    int c = cond->SpeculationCost(), t = trueExpr->SpeculationCost(), f = falseExpr->SpeculationCost();
+    return (c < 0 || t < 0 || f < 0) ? -1 : c + t + f + 1;
+}
 
-        if(leftType->isFloatTy() || leftType->isVectorTy()) {
-            llvm::Value* res = llvm::BinaryOperator::CreateFAdd(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
+int FieldAccess::SpeculationCost() {
+    int cost = base ? base->SpeculationCost() : 0;
+    return (cost < 0) ? -1 : cost + 1;
+}
 
-        else if (leftType->isIntegerTy()) {
-            llvm::Value* res = llvm::BinaryOperator::CreateAdd(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
+/* Function: EmitSelectOrBranch
+ * ----------------------------
+ * Lowers "cond ? t : f" where either arm may be an expression or, with
+ * the expression NULL, an already known value (a && b is b or false).
+ * When both arms are cheap and free of side effects they are evaluated
+ * up front and chosen with a select, which costs no branch to mispredict.
+ * Otherwise each arm is evaluated in a block of its own, only on its
+ * path, and a phi in the block after them picks the result.
+ */
+static llvm::Value *EmitSelectOrBranch(llvm::Value *cond, Expr *t, llvm::Value *tval,
+                                       Expr *f, llvm::Value *fval, const char *name) {
+    IRGenerator *irgen = Node::irgen;
+    int tcost = t ? t->SpeculationCost() : 0, fcost = f ? f->SpeculationCost() : 0;
+
+    if (tcost >= 0 && fcost >= 0 && tcost + fcost <= MaxSelectCost) {
+        if (t) tval = t->EmitValue();
+        if (f) fval = f->EmitValue();
+        return llvm::SelectInst::Create(cond, tval, fval, name, irgen->GetBasicBlock());
     }
 
-    else if (op->IsOp("-=") == true) {
-        if(lenght != ZERO) {
-            llvm::Value* baseAdd = new llvm::LoadInst(lhsVal, "", irgen->GetBasicBlock());
-            llvm::Constant* id;
-
-            if (rightType->isVectorTy()) {
-                int i = ZERO;
-                while ( i < lenght) {
-                    char c = swizzle[i];
-                    switch(c){
-                    case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                    case 'y': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                    case 'z': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                    default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                    }
-                    llvm::Constant* idx = llvm::ConstantInt::get(irgen->GetIntType(), i);
-                    llvm::Value* extractrhs = llvm::ExtractElementInst::Create(right->Emit(), idx, "", irgen->GetBasicBlock());
-                    llvm::Value* extractlhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFSub(extractlhs, extractrhs, "", irgen->GetBasicBlock());
-
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    i++;
-                }
-            }
-
-            else if (rightType->isFloatTy() == true) {
-	      int i = ZERO;
-                while (i < lenght) {
-                    char option = swizzle[i];
-                    switch(option)
-		    {
-                    case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                    case'y':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                    case 'z': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                    default: 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                    }
-                    llvm::Value* extractlhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFSub(extractlhs, right->Emit(), "", irgen->GetBasicBlock());
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    i++;
-                }
-
-                llvm::Value* res = new llvm::StoreInst(baseAdd, lhsVal, "", irgen->GetBasicBlock());
-		(void) res;
-                return right->Emit();
-            }
-        }
-
-        lhs = left->Emit();
-        leftType = left->Emit()->getType();
-
-        if(leftType->isFloatTy() || leftType->isVectorTy()) {
-            llvm::Value* res = llvm::BinaryOperator::CreateFSub(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
-
-        else if (leftType->isIntegerTy()== true) {
-            llvm::Value* res = llvm::BinaryOperator::CreateSub(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
+    llvm::LLVMContext *c = irgen->GetContext();
+    llvm::Function *fn = irgen->GetFunction();
+    llvm::BasicBlock *entryB = irgen->GetBasicBlock();
+    llvm::BasicBlock *trueB = t ? llvm::BasicBlock::Create(*c, "cond_true", fn) : NULL;
+    llvm::BasicBlock *falseB = f ? llvm::BasicBlock::Create(*c, "cond_false", fn) : NULL;
+    llvm::BasicBlock *endB = llvm::BasicBlock::Create(*c, "cond_end", fn);
+    llvm::BranchInst::Create(trueB ? trueB : endB, falseB ? falseB : endB, cond, entryB);
+
+    // an arm given as a value comes straight from the entry block
+    llvm::BasicBlock *tEnd = entryB, *fEnd = entryB;
+    if (t) {
+        irgen->SetBasicBlock(trueB);
+        tval = t->EmitValue();
+        tEnd = irgen->GetBasicBlock();
+        llvm::BranchInst::Create(endB, tEnd);
     }
-
-    else if (op->IsOp("*=")== true) {
-        if (lenght != ZERO) {
-            llvm::Value* baseAdd = new llvm::LoadInst(lhsVal, "", irgen->GetBasicBlock());
-            llvm::Constant* id;
-
-            if (rightType->isVectorTy()) {
-                int step = ZERO;
-                while (step < lenght) {
-                    char c = swizzle[step];
-                    switch(c){
-                    case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                    case 'y': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                    case 'z':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                    default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-		    }	
-
-                    llvm::Constant* idx = llvm::ConstantInt::get(irgen->GetIntType(), step);
-                    llvm::Value* extractrhs = llvm::ExtractElementInst::Create(right->Emit(), idx, "", irgen->GetBasicBlock());
-                    llvm::Value* extractlhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFMul(extractlhs, extractrhs, "", irgen->GetBasicBlock());
-
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    step++;
-                }
-            }
-
-            else if (rightType->isFloatTy()) {
-	      int i = ZERO; 
-                while (i < lenght) {
-                    char option = swizzle[i];
-                    switch(option){
-                     case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                      case 'y':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                      case 'z': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                      default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-		    }	
-
-                    llvm::Value* extractlhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFMul(extractlhs, right->Emit(), "", irgen->GetBasicBlock());
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    i++;
-                }
-
-                llvm::Value* res = new llvm::StoreInst(baseAdd, lhsVal, "", irgen->GetBasicBlock());
-                (void) res;
-		return right->Emit();
-            }
-        }
-
-        lhs = left->Emit();
-        leftType = left->Emit()->getType();
-
-        if(leftType->isFloatTy() || leftType->isVectorTy()) {
-            llvm::Value* res = llvm::BinaryOperator::CreateFMul(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
-
-        else if (leftType->isIntegerTy()) {
-            llvm::Value* res = llvm::BinaryOperator::CreateMul(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
+    if (f) {
+        irgen->SetBasicBlock(falseB);
+        fval = f->EmitValue();
+        fEnd = irgen->GetBasicBlock();
+        llvm::BranchInst::Create(endB, fEnd);
     }
 
-    else if (op->IsOp("/=")) {
-        if (lenght != ZERO) {
-            llvm::Value* baseAdd = new llvm::LoadInst(lhsVal, "", irgen->GetBasicBlock());
-            llvm::Constant* id;
-
-            if (rightType->isVectorTy()) {
-	        int i = ZERO;
-                while ( i < lenght) {
-                    char c = swizzle[i];
-                    switch(c){
-                     case 'x':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                     case 'y': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                     case 'z': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                     default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                    }
-                    llvm::Constant* idx = llvm::ConstantInt::get(irgen->GetIntType(), i);
-                    llvm::Value* extractrhs = llvm::ExtractElementInst::Create(right->Emit(), idx, "", irgen->GetBasicBlock());
-                    llvm::Value* extractlhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFDiv(extractlhs, extractrhs, "", irgen->GetBasicBlock());
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    i = i+1;
-                }
-            }
-
-            else if (rightType->isFloatTy()) {
-	        int i = ZERO;
-                while ( i < lenght) {
-                    char option = swizzle[i];
-                    switch(option){
-                    case 'x': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                    case 'y': 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                    case 'z':
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                    default : 
-                        id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                    }
-                    llvm::Value* elhs = llvm::ExtractElementInst::Create(baseAdd, id, "", irgen->GetBasicBlock());
-                    llvm::Value* binaryOp = llvm::BinaryOperator::CreateFDiv(elhs, right->Emit(), "", irgen->GetBasicBlock());
-                    baseAdd = llvm::InsertElementInst::Create(baseAdd, binaryOp, id, "", irgen->GetBasicBlock());
-		    i++;
-                }
-
-                llvm::Value* res = new llvm::StoreInst(baseAdd, lhsVal, "", irgen->GetBasicBlock());
-                (void) res;
-		return right->Emit();
-            }
-        }
-
-        lhs = left->Emit();
-        leftType = left->Emit()->getType();
-
-        if(leftType->isFloatTy() || leftType->isVectorTy()) {
-            llvm::Value* res = llvm::BinaryOperator::CreateFDiv(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
+    irgen->SetBasicBlock(endB);
+    llvm::PHINode *phi = llvm::PHINode::Create(tval->getType(), 2, name, endB);
+    phi->addIncoming(tval, tEnd);
+    phi->addIncoming(fval, fEnd);
+    return phi;
+}
 
-        else if (leftType->isIntegerTy()) {
-            llvm::Value* res = llvm::BinaryOperator::CreateSDiv(left->Emit(), right->Emit(), "", irgen->GetBasicBlock());
-            new llvm::StoreInst(res, lhsVal, irgen->GetBasicBlock());
-            return res;
-        }
-    }    
-    
-    return NULL; 
-    
-} 
+/* a && b is b when a holds and false otherwise; a || b is true when a
+ * holds and b otherwise. b is only evaluated when a leaves it to decide,
+ * unless it is cheap and harmless enough to compute regardless. */
+llvm::Value* LogicalExpr::Emit() {
+    llvm::Value *lhs = left->EmitValue();
+    if (op->IsOp("&&"))
+        return EmitSelectOrBranch(lhs, right, NULL, NULL,
+                                  llvm::ConstantInt::getFalse(*irgen->GetContext()), "and");
+    if (op->IsOp("||"))
+        return EmitSelectOrBranch(lhs, NULL, llvm::ConstantInt::getTrue(*irgen->GetContext()),
+                                  right, NULL, "or");
+    return NULL;
+}
 
-llvm::Value* FieldAccess::Emit() {
-    llvm::Value* lhs = base->Emit();
-    const char* fieldName = field->GetName();
+llvm::Value* ConditionalExpr::Emit() {
+    return EmitSelectOrBranch(cond->EmitValue(), trueExpr, NULL, falseExpr, NULL, "cond");
+}
 
-    std::vector<llvm::Constant*> consts;
+/* Function: BlendLanes
+ * --------------------
+ * Writes val into the given lanes of whole for a swizzled assignment. A
+ * single component is one insertelement; several are one shufflevector
+ * that takes each written lane from val and every other lane from whole.
+ * A val narrower than whole is first widened to whole's lane count,
+ * since both shuffle operands must have the same type.
+ */
+static llvm::Value *BlendLanes(llvm::Value *whole, llvm::Value *val, const vector<int> &lanes) {
+    llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
+    llvm::LLVMContext *c = Node::irgen->GetContext();
+    llvm::Type *i32 = llvm::Type::getInt32Ty(*c);
+
+    if (lanes.size() == 1)
+        return llvm::InsertElementInst::Create(whole, val, llvm::ConstantInt::get(i32, lanes[ZERO]), "", bb);
+
+    unsigned width = whole->getType()->getVectorNumElements();
+    if (val->getType()->getVectorNumElements() != width) {
+        vector<llvm::Constant*> widen;
+        for (unsigned i = 0; i < width; i++)
+            widen.push_back(i < val->getType()->getVectorNumElements()
+                            ? llvm::ConstantInt::get(i32, i) : llvm::UndefValue::get(i32));
+        val = new llvm::ShuffleVectorInst(val, llvm::UndefValue::get(val->getType()),
+                                          llvm::ConstantVector::get(widen), "", bb);
+    }
 
-    int fieldLength = strlen(fieldName);
+    vector<llvm::Constant*> mask;
+    for (unsigned k = 0; k < width; k++)
+        mask.push_back(llvm::ConstantInt::get(i32, k));
+    for (size_t i = 0; i < lanes.size(); i++)
+        mask[lanes[i]] = llvm::ConstantInt::get(i32, width + i);
+    return new llvm::ShuffleVectorInst(whole, val, llvm::ConstantVector::get(mask), "blend", bb);
+}
 
-    if (fieldLength == 1) {
-        char option = fieldName[ZERO];
-     
-    switch (option) {
+/* Method: AssignExpr::Emit
+ * ------------------------
+ * x op= y is emitted as x = x op y through EmitArithmetic, so it takes
+ * the same scalar, vector and matrix paths as the binary operators. A
+ * swizzled target (v.xz = ...) reads the lanes with one shuffle, applies
+ * one vector operation for op=, and blends the result back into the
+ * whole vector, which is stored with one aligned store. The value of the
+ * expression is the value assigned.
+ */
+llvm::Value* AssignExpr::Emit() {
+    FieldAccess *swizzle = dynamic_cast<FieldAccess*>(left);
+    llvm::Value *addr = NULL;
+    if (VarExpr *var = dynamic_cast<VarExpr*>(left))
+        addr = var->getValue();
+    else if (swizzle != NULL)
+        addr = swizzle->getValue();
+    Assert(addr != NULL);
+
+    llvm::Value *val = right->EmitValue();
+    if (!op->IsOp("=")) {
+        char opName[2] = { op->IsOp("+=") ? '+' : op->IsOp("-=") ? '-' : op->IsOp("*=") ? '*' : '/', '\0' };
+        val = EmitArithmetic(opName, left->EmitValue(), left->type, val, right->type, left->type);
+    }
 
-     case 'c' :
-     {
+    llvm::BasicBlock *bb = irgen->GetBasicBlock();
+    if (swizzle == NULL) {
+        new llvm::StoreInst(val, addr, bb);
+        return val;
+    }
 
-            llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-            llvm::Value* res = llvm::ExtractElementInst::Create(base->Emit(), id, "", irgen->GetBasicBlock());
-            return res;
-        }
+    // the operands were emitted first, so the whole vector loaded now (or
+    // already by op=) is current
+    vector<int> lanes;
+    llvm::Value *whole = swizzle->GetLanes(lanes)->EmitValue();
+    new llvm::StoreInst(BlendLanes(whole, val, lanes), addr, bb);
+    return val;
+}
 
-      case 'y':
-      
-      {
-            llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-            llvm::Value* res = llvm::ExtractElementInst::Create(base->Emit(), id, "", irgen->GetBasicBlock());
-            return res;
-        }
 
-       case 'z': {
-            llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-            llvm::Value* res = llvm::ExtractElementInst::Create(base->Emit(), id, "", irgen->GetBasicBlock());
-            return res;
-        }
+Expr *FieldAccess::GetLanes(vector<int> &lanes) {
+    const char *name = field->GetName();
+    vector<int> own;
+    for (int i = 0; name[i] != '\0'; i++)
+        own.push_back(SwizzleLane(name[i]));
 
-       default : {
-            llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-            llvm::Value* res = llvm::ExtractElementInst::Create(base->Emit(), id, "", irgen->GetBasicBlock());
-            return res;
-     
-       }
-      }
+    Expr *root = base;
+    lanes = own;
+    if (FieldAccess *inner = dynamic_cast<FieldAccess*>(base)) {
+        vector<int> baseLanes;
+        root = inner->GetLanes(baseLanes);
+        for (size_t i = 0; i < own.size(); i++)
+            lanes[i] = baseLanes[own[i]];
     }
+    return root;
+}
 
-    else {
-        int i = ZERO;
-        while ( i < fieldLength) {
-            char option = fieldName[i];
-            switch(option)
-	    {
-            case 'x': {
-                llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), ZERO);
-                consts.push_back(id);
-            }
-
-            case 'y': {
-                llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), 1);
-                consts.push_back(id);
-            }
-
-            case 'z': {
-                llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), 2);
-                consts.push_back(id);
-            }
-
-            default: {
-                llvm::Constant* id = llvm::ConstantInt::get(irgen->GetIntType(), 3);
-                consts.push_back(id);
-             }
-	    }
-	  i = i + 1;  
-        }
-
-        llvm::ConstantVector* cv = (llvm::ConstantVector*)llvm::ConstantVector::get(consts);
-        llvm::Value* res = new llvm::ShuffleVectorInst(lhs, llvm::UndefValue::get(
-            lhs->getType()), cv, "", irgen->GetBasicBlock());
-        return res;
-    }
+/* Method: FieldAccess::Emit
+ * -------------------------
+ * One component is an extractelement; anything longer is a single
+ * shufflevector of the vector the swizzle chain starts from, padded to 4
+ * lanes for a 3-component result like every other vec3.
+ */
+llvm::Value* FieldAccess::Emit() {
+    vector<int> lanes;
+    llvm::Value *vec = GetLanes(lanes)->EmitValue();
+    llvm::BasicBlock *bb = irgen->GetBasicBlock();
+    llvm::Type *i32 = irgen->GetIntType();
+
+    if (lanes.size() == 1)
+        return llvm::ExtractElementInst::Create(vec, llvm::ConstantInt::get(i32, lanes[ZERO]), "", bb);
+
+    vector<llvm::Constant*> mask;
+    for (size_t i = 0; i < lanes.size(); i++)
+        mask.push_back(llvm::ConstantInt::get(i32, lanes[i]));
+    while ((int)mask.size() < IRGenerator::PaddedLanes(lanes.size()))
+        mask.push_back(llvm::UndefValue::get(i32));
+    return new llvm::ShuffleVectorInst(vec, llvm::UndefValue::get(vec->getType()),
+                                       llvm::ConstantVector::get(mask), "swizzle", bb);
 }
 
 llvm::Value* FieldAccess::getValue() {
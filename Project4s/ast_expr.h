@@ -18,13 +18,15 @@
 #include "list.h"
 #include "ast_type.h"
 
+class FnDecl;
+
 void yyerror(const char *msg);
 
 class Expr : public Stmt 
 {
   public:
-    Expr(yyltype loc) : Stmt(loc) {}
-    Expr() : Stmt() {}
+    Expr(yyltype loc) : Stmt(loc), type(NULL), emitted(NULL), emittedBB(NULL), emittedEpoch(0) { numNodes++; }
+    Expr() : Stmt(), type(NULL), emitted(NULL), emittedBB(NULL), emittedEpoch(0) { numNodes++; }
     //Added type for checking purposes
     Type* type;
 
@@ -33,6 +35,34 @@ class Expr : public Stmt
     }
     llvm::Value* getValue() {return NULL;}
 
+    // Parents lower their operands through EmitValue() rather than Emit()
+    // so that each node is emitted once per evaluation point and the
+    // resulting llvm::Value is reused by every later request for it.
+    llvm::Value* EmitValue();
+
+    // Constant folding (see Program::Fold) returns the expression that
+    // replaces this one: a new constant, an operand that survives an
+    // identity such as x*1, or the node itself. Parents store whatever
+    // their children return.
+    virtual Expr *Fold() { return this; }
+
+    // Roughly how many instructions evaluating this expression costs, or
+    // -1 if it has side effects or may trap and so must only be evaluated
+    // when the program would. ?: and && / || use it to decide between a
+    // select over both operands and branches with a phi.
+    virtual int SpeculationCost() { return -1; }
+
+    // Counters reported by -d emitstats, kept per thread. emitEpoch is
+    // bumped by every Program::Emit so values memoized by an earlier pass
+    // are never reused. numFolded counts the nodes Fold() replaced.
+    static thread_local int numNodes, numLowered, numReused;
+    static thread_local int emitEpoch;
+    static thread_local int numFolded;
+
+  protected:
+    llvm::Value *emitted;        // value from the last lowering
+    llvm::BasicBlock *emittedBB; // block that lowering finished in
+    int emittedEpoch;
 };
 
 class ExprError : public Expr
@@ -50,6 +80,7 @@ class EmptyExpr : public Expr
 {
   public:
     const char *GetPrintNameForNode() { return "Empty"; }
+    void Check() { type = Type::voidType; }
 };
 
 class IntConstant : public Expr 
@@ -61,6 +92,9 @@ class IntConstant : public Expr
     IntConstant(yyltype loc, int val);
     const char *GetPrintNameForNode() { return "IntConstant"; }
     void PrintChildren(int indentLevel);
+    int SpeculationCost() { return 0; }
+    int GetValue() const { return value; }
+    void Check();
     llvm::Value* Emit();
 };
 
@@ -73,6 +107,9 @@ class FloatConstant: public Expr
     FloatConstant(yyltype loc, double val);
     const char *GetPrintNameForNode() { return "FloatConstant"; }
     void PrintChildren(int indentLevel);
+    int SpeculationCost() { return 0; }
+    double GetValue() const { return value; }
+    void Check();
     llvm::Value* Emit();
 };
 
@@ -85,6 +122,9 @@ class BoolConstant : public Expr
     BoolConstant(yyltype loc, bool val);
     const char *GetPrintNameForNode() { return "BoolConstant"; }
     void PrintChildren(int indentLevel);
+    int SpeculationCost() { return 0; }
+    bool GetValue() const { return value; }
+    void Check();
     llvm::Value* Emit();
 };
 
@@ -92,12 +132,16 @@ class VarExpr : public Expr
 {
   protected:
     Identifier *id;
+    VarDecl *decl;  // bound by Check()
 
   public:
     VarExpr(yyltype loc, Identifier *id);
     const char *GetPrintNameForNode() { return "VarExpr"; }
     void PrintChildren(int indentLevel);
     Identifier *GetIdentifier() {return id;}
+    VarDecl *GetDecl() const { return decl; }
+    int SpeculationCost() { return 1; }
+    void Check();
     llvm::Value* Emit();
     llvm::Value* getValue();
 };
@@ -128,6 +172,9 @@ class CompoundExpr : public Expr
     CompoundExpr(Operator *op, Expr *rhs);             // for unary
     CompoundExpr(Expr *lhs, Operator *op);             // for unary
     void PrintChildren(int indentLevel);
+    void Check();
+    Expr *Fold();
+    int SpeculationCost();
 };
 
 class ArithmeticExpr : public CompoundExpr 
@@ -136,6 +183,8 @@ class ArithmeticExpr : public CompoundExpr
     ArithmeticExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     ArithmeticExpr(Operator *op, Expr *rhs) : CompoundExpr(op,rhs) {}
     const char *GetPrintNameForNode() { return "ArithmeticExpr"; }
+    void Check();
+    Expr *Fold();
     llvm::Value* Emit();
     llvm::Value* getValue() { if(left != NULL) return left->getValue();
                               else return right->getValue(); }
@@ -146,6 +195,8 @@ class RelationalExpr : public CompoundExpr
   public:
     RelationalExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     const char *GetPrintNameForNode() { return "RelationalExpr"; }
+    void Check();
+    Expr *Fold();
     llvm::Value* Emit();
     llvm::Value* getValue() {return left->getValue();}
 };
@@ -155,6 +206,8 @@ class EqualityExpr : public CompoundExpr
   public:
     EqualityExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     const char *GetPrintNameForNode() { return "EqualityExpr"; }
+    void Check();
+    Expr *Fold();
     llvm::Value* Emit();
     llvm::Value* getValue() {return left->getValue();}
 };
@@ -165,6 +218,8 @@ class LogicalExpr : public CompoundExpr
     LogicalExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     LogicalExpr(Operator *op, Expr *rhs) : CompoundExpr(op,rhs) {}
     const char *GetPrintNameForNode() { return "LogicalExpr"; }
+    void Check();
+    Expr *Fold();
     llvm::Value* Emit();
     llvm::Value* getValue() {return left->getValue();}
 };
@@ -174,6 +229,8 @@ class AssignExpr : public CompoundExpr
   public:
     AssignExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     const char *GetPrintNameForNode() { return "AssignExpr"; }
+    int SpeculationCost() { return -1; }
+    void Check();
     llvm::Value* Emit();
     llvm::Value* getValue() {return left->getValue();}
 };
@@ -183,7 +240,9 @@ class PostfixExpr : public CompoundExpr
   public:
     PostfixExpr(Expr *lhs, Operator *op) : CompoundExpr(lhs,op) {}
     const char *GetPrintNameForNode() { return "PostfixExpr"; }
+    int SpeculationCost() { return -1; }
     llvm::Value* getValue() {return left->getValue();}
+    void Check();
     llvm::Value* Emit();
 };
 
@@ -194,6 +253,10 @@ class ConditionalExpr : public Expr
   public:
     ConditionalExpr(Expr *c, Expr *t, Expr *f);
     void PrintChildren(int indentLevel);
+    void Check();
+    Expr *Fold();
+    int SpeculationCost();
+    llvm::Value* Emit();
     const char *GetPrintNameForNode() { return "ConditionalExpr"; }
 };
 
@@ -212,6 +275,8 @@ class ArrayAccess : public LValue
     ArrayAccess(yyltype loc, Expr *base, Expr *subscript);
     const char *GetPrintNameForNode() { return "ArrayAccess"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Expr *Fold();
 };
 
 /* Note that field access is used both for qualified names
@@ -230,9 +295,17 @@ class FieldAccess : public LValue
     FieldAccess(Expr *base, Identifier *field);
     const char *GetPrintNameForNode() { return "FieldAccess"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Expr *Fold();
+    int SpeculationCost();
     llvm::Value* Emit();
     llvm::Value* getValue();
     Identifier* getFieldId() {return field;}
+
+    // Fills lanes with the components of the underlying vector that the
+    // swizzle selects, in order, looking through swizzled bases (v.zyx.xy
+    // is lanes 2, 1 of v), and returns the expression giving that vector.
+    Expr *GetLanes(vector<int> &lanes);
 };
 
 /* Like field access, call is used both for qualified base.field()
@@ -245,12 +318,16 @@ class Call : public Expr
     Expr *base;	// will be NULL if no explicit base
     Identifier *field;
     List<Expr*> *actuals;
+    FnDecl *fn;  // bound by Check()
     
   public:
-    Call() : Expr(), base(NULL), field(NULL), actuals(NULL) {}
+    Call() : Expr(), base(NULL), field(NULL), actuals(NULL), fn(NULL) {}
     Call(yyltype loc, Expr *base, Identifier *field, List<Expr*> *args);
     const char *GetPrintNameForNode() { return "Call"; }
     void PrintChildren(int indentLevel);
+    FnDecl *GetFnDecl() const { return fn; }
+    void Check();
+    Expr *Fold();
 };
 
 class ActualsError : public Call
@@ -7,13 +7,19 @@
 #include "ast_decl.h"
 #include "ast_expr.h"
 #include "symtable.h"
+#include "errors.h"
 
 #include "irgen.h"
-#include "llvm/Bitcode/ReaderWriter.h"
-#include "llvm/Support/raw_ostream.h"                                                   
+#include "threadpool.h"
+#include "context.h"
+#include "cache.h"
+#include "timing.h"
+#include "llvm/Support/raw_os_ostream.h"
+#include <string>
+#include <set>
 
 
-Program::Program(List<Decl*> *d) {
+Program::Program(List<Decl*> *d) : numGlobals(0) {
     Assert(d != NULL);
     (decls=d)->SetParentAll(this);
 }
@@ -23,18 +29,198 @@ void Program::PrintChildren(int indentLevel) {
     printf("\n");
 }
 
-llvm::Value* Program::Emit() {
-    llvm::Module *module = irgen->GetOrCreateModule("mod.bc");
+void Program::Check() {
+    Timing::Phase phase("check");
     symTable->push();
-    int i =0;
-    while (i < decls->NumElements()) {
+    VarDecl::nextGlobalSlot = 0;
+    for (int i = 0; i < decls->NumElements(); i++)
+        decls->Nth(i)->Check();
+    numGlobals = VarDecl::nextGlobalSlot;
+    symTable->pop();
+}
+
+/* Method: Fold
+ * ------------
+ * Folds constant expressions and statements with constant conditions in
+ * every function body, so that neither the tree nor the IR emitted from
+ * it carries them. Like a C front end folding constant expressions, this
+ * happens at every optimization level.
+ */
+void Program::Fold() {
+    Timing::Phase phase("fold");
+    Expr::numFolded = 0;
+    for (int i = 0; i < decls->NumElements(); i++)
+        if (FnDecl *fn = dynamic_cast<FnDecl*>(decls->Nth(i)))
+            fn->Fold();
+    if (IsDebugOn("foldstats"))
+        fprintf(stderr, "foldstats: %d nodes folded\n", Expr::numFolded);
+}
+
+/* Function: EmitFunctionAlone
+ * ----------------------------
+ * Emits and optimizes fn on the calling thread into a module of its own,
+ * with its own IRGenerator and LLVMContext, and returns that module as
+ * bitcode. The program's globals are redeclared there so the linker can
+ * resolve them against the definitions in the main module; those the
+ * function does not use are dropped again, so that a cached copy stays
+ * valid when unrelated globals come and go. The calling
+ * thread's Node statics are restored afterwards, since the pool runs
+ * some of the work on the thread that is emitting the program.
+ */
+static std::string EmitFunctionAlone(FnDecl *fn, List<Decl*> *decls, int numGlobals,
+                                     int epoch, unsigned &numEmitted)
+{
+    IRGenerator *savedIrgen = Node::irgen;
+    vector<llvm::BasicBlock*> *savedBreak = Node::breakBB, *savedContinue = Node::continueBB;
+    int savedEpoch = Expr::emitEpoch;
+
+    IRGenerator gen;
+    vector<llvm::BasicBlock*> breakBB, continueBB;
+    Node::irgen = &gen;
+    Node::breakBB = &breakBB;
+    Node::continueBB = &continueBB;
+    Expr::emitEpoch = epoch;
+    Timing::Phase phase("emit");
+
+    gen.GetOrCreateModule(fn->getId());
+    gen.ResetGlobalSlots(numGlobals);
+    for (int i = 0; i < decls->NumElements(); i++)
+        if (VarDecl *var = dynamic_cast<VarDecl*>(decls->Nth(i)))
+            var->EmitExternal();
+    fn->Emit();
+    numEmitted = gen.NumInstructions();
+    gen.Optimize(GetOptimizationLevel());
+    gen.RemoveUnusedDeclarations();
+
+    std::string bitcode;
+    gen.WriteBitcode(bitcode);
+
+    Node::irgen = savedIrgen;
+    Node::breakBB = savedBreak;
+    Node::continueBB = savedContinue;
+    Expr::emitEpoch = savedEpoch;
+    return bitcode;
+}
+
+/* Method: EmitFunctionsSeparately
+ * --------------------------------
+ * The globals are defined in the main module first; every function is
+ * then emitted and optimized in a module of its own against that
+ * snapshot of the global scope, on the -j pool, and linked back in
+ * declaration order, so the module does not depend on scheduling.
+ *
+ * With a compile cache, a function whose key (see cache.h) was seen
+ * before is taken from the cache instead, and only the others are
+ * emitted; those are stored for next time. A cached entry that cannot
+ * be read or linked (a truncated or corrupted file) is dropped, and the
+ * function is emitted again and stored in its place. Returns the number
+ * of instructions emitted before optimization.
+ */
+unsigned Program::EmitFunctionsSeparately(CompileCache *cache, const vector<std::string> *keys) {
+    vector<FnDecl*> fns;
+    vector<std::string> fnKeys;
+    for (int i = 0; i < decls->NumElements(); i++) {
         Decl *d = decls->Nth(i);
-        d->Emit();
-	i++;
+        if (FnDecl *fn = dynamic_cast<FnDecl*>(d)) {
+            fns.push_back(fn);
+            fnKeys.push_back(keys ? (*keys)[i] : std::string());
+        }
+        else
+            d->Emit();
+    }
+
+    int n = fns.size();
+    vector<std::string> bitcode(n);
+    vector<unsigned> numEmitted(n, 0);
+    vector<int> misses;
+    vector<char> cached(n, false);
+    for (int i = 0; i < n; i++) {
+        if (cache != NULL && cache->Lookup(fnKeys[i], bitcode[i]))
+            cached[i] = true;
+        else
+            misses.push_back(i);
+    }
+
+    int epoch = Expr::emitEpoch;
+    CompilationContext *ctx = CompilationContext::Current();
+    WorkStealingPool pool(ctx ? ctx->GetNumJobs() : GetNumJobs());
+    pool.Run(misses.size(), [&](int m) {
+        int i = misses[m];
+        bitcode[i] = EmitFunctionAlone(fns[i], decls, numGlobals, epoch, numEmitted[i]);
+    });
+    if (cache != NULL)
+        for (size_t m = 0; m < misses.size(); m++)
+            cache->Store(fnKeys[misses[m]], bitcode[misses[m]]);
+    if (IsDebugOn("cache"))
+        fprintf(stderr, "cache: %d of %d functions reused\n", n - (int)misses.size(), n);
+
+    unsigned total = irgen->NumInstructions();
+    for (int i = 0; i < n; i++) {
+        bool linked = irgen->LinkBitcode(bitcode[i]);
+        if (!linked && cached[i]) {
+            if (IsDebugOn("cache"))
+                fprintf(stderr, "cache: bad entry %s, emitting %s again\n",
+                        fnKeys[i].c_str(), fns[i]->getId());
+            cache->Remove(fnKeys[i]);
+            bitcode[i] = EmitFunctionAlone(fns[i], decls, numGlobals, epoch, numEmitted[i]);
+            linked = irgen->LinkBitcode(bitcode[i]);
+            if (linked)
+                cache->Store(fnKeys[i], bitcode[i]);
+        }
+        if (!linked)
+            Failure("Cannot link the module emitted for function %s", fns[i]->getId());
+        total += numEmitted[i];
+    }
+    return total;
+}
+
+llvm::Value* Program::Emit() {
+    Timing::Phase phase("emit");
+    llvm::Module *module = irgen->GetOrCreateModule("mod.bc");
+    Expr::emitEpoch++;
+    irgen->ResetGlobalSlots(numGlobals);
+
+    // functions are emitted one module each when they can come from the
+    // cache, or with -j and a single program to spread over the threads
+    CompilationContext *ctx = CompilationContext::Current();
+    CompileCache *cache = ctx ? ctx->GetFunctionCache() : NULL;
+    const vector<std::string> *keys = ctx ? &ctx->GetDeclKeys() : NULL;
+    if (keys == NULL || (int)keys->size() != decls->NumElements())
+        cache = NULL, keys = NULL;  // declarations were not split as parsed
+
+    unsigned numEmitted;
+    int jobs = ctx ? ctx->GetNumJobs() : GetNumJobs();
+    if (cache != NULL || (jobs > 1 && NumInputFiles() <= 1)) {
+        numEmitted = EmitFunctionsSeparately(cache, keys);
+    }
+    else {
+        int i =0;
+        while (i < decls->NumElements()) {
+            Decl *d = decls->Nth(i);
+            d->Emit();
+            i++;
+        }
+        numEmitted = irgen->NumInstructions();
+        irgen->Optimize(GetOptimizationLevel());
+    }
+    if (IsDebugOn("emitstats"))
+        fprintf(stderr, "emitstats: %d expression nodes, %d lowered, %d reused\n",
+                Expr::numNodes, Expr::numLowered, Expr::numReused);
+
+    if (IsDebugOn("optstats"))
+        fprintf(stderr, "optstats: -O%d %u instructions emitted, %u after optimization\n",
+                GetOptimizationLevel(), numEmitted, irgen->NumInstructions());
+    Timing::Count(Timing::InstructionsEmitted, numEmitted);
+    Timing::Count(Timing::Instructions, irgen->NumInstructions());
+    Timing::Count(Timing::BasicBlocks, irgen->NumBasicBlocks());
+
+    // the IR goes to the unit's diagnostic stream, so under glc -j each
+    // unit's listing stays whole and in input order
+    if (IsDebugOn("ir")) {
+        Timing::Phase dump("dump");
+        llvm::raw_os_ostream out(ReportError::Output());
+        module->print(out, NULL);
     }
-    symTable->pop();
-    module->dump();
-    llvm::WriteBitcodeToFile(module, llvm::outs());
 
     return NULL;
 }
@@ -52,8 +238,16 @@ void StmtBlock::PrintChildren(int indentLevel) {
     stmts->PrintAll(indentLevel+1);
 }
 
-llvm::Value* StmtBlock::Emit() {
+void StmtBlock::Check() {
     symTable->push();
+    for (int i = 0; i < decls->NumElements(); i++)
+        decls->Nth(i)->Check();
+    for (int i = 0; i < stmts->NumElements(); i++)
+        stmts->Nth(i)->Check();
+    symTable->pop();
+}
+
+llvm::Value* StmtBlock::Emit() {
     int step = 0;
     while (step < decls->NumElements()) {
         decls->Nth(step);
@@ -67,11 +261,26 @@ llvm::Value* StmtBlock::Emit() {
        i++;	
     }
 
-    symTable->pop();
     return NULL;
 
 }
 
+Stmt *StmtBlock::Fold() {
+    for (int i = 0; i < stmts->NumElements(); i++) {
+        stmts->SetNth(i, stmts->Nth(i)->Fold());
+        stmts->Nth(i)->SetParent(this);
+    }
+    return this;
+}
+
+/* What a statement that folded away is replaced with */
+static Stmt *NoStmt() {
+    Expr *empty = new EmptyExpr();
+    empty->Check();
+    Expr::numFolded++;
+    return empty;
+}
+
 DeclStmt::DeclStmt(Decl *d) {
     Assert(d != NULL);
     (decl=d)->SetParent(this);
@@ -81,6 +290,10 @@ void DeclStmt::PrintChildren(int indentLevel) {
     decl->Print(indentLevel+1);
 }
 
+void DeclStmt::Check() {
+    decl->Check();
+}
+
 llvm::Value* DeclStmt::Emit() {
     decl->Emit();
     return NULL;
@@ -108,6 +321,30 @@ void ForStmt::PrintChildren(int indentLevel) {
     body->Print(indentLevel+1, "(body) ");
 }
 
+void ForStmt::Check() {
+    init->Check();
+    test->Check();
+    if (step) step->Check();
+    symTable->push();
+    body->Check();
+    symTable->pop();
+}
+
+/* A loop whose test is false from the start runs only its init */
+Stmt *ForStmt::Fold() {
+    (init=init->Fold())->SetParent(this);
+    (test=test->Fold())->SetParent(this);
+    if (step) (step=step->Fold())->SetParent(this);
+    (body=body->Fold())->SetParent(this);
+
+    BoolConstant *c = dynamic_cast<BoolConstant*>(test);
+    if (c != NULL && !c->GetValue()) {
+        Expr::numFolded++;
+        return init;
+    }
+    return this;
+}
+
 llvm::Value* ForStmt::Emit() {
     /*
     symTable->push();
@@ -145,22 +382,23 @@ llvm::Value* ForStmt::Emit() {
     llvm::BasicBlock *bodyB = llvm::BasicBlock::Create(*c, "body", f);
     llvm::BasicBlock *footB = llvm::BasicBlock::Create(*c, "foot", f);
 
-    init->Emit();
+    // the test, step and body may each end in a block of their own (a
+    // short-circuiting && or ?:), so each is closed where it ended
+    init->EmitValue();
     llvm::BranchInst::Create(headB,irgen->GetBasicBlock());
     irgen->SetBasicBlock(headB);
      
-    llvm::Value* value = test->Emit();
-    llvm::BranchInst::Create(bodyB, footB, value, headB);
-    symTable->push();
+    llvm::Value* value = test->EmitValue();
+    llvm::BranchInst::Create(bodyB, footB, value, irgen->GetBasicBlock());
     breakBB->push_back(footB);
     continueBB->push_back(stepB);
     irgen->SetBasicBlock(bodyB);
     body->Emit();
-    llvm::BranchInst::Create(stepB, irgen->GetBasicBlock());
-    symTable->pop();
+    if (!irgen->GetBasicBlock()->getTerminator())
+        llvm::BranchInst::Create(stepB, irgen->GetBasicBlock());
     irgen->SetBasicBlock(stepB);
-    step->Emit();
-    llvm::BranchInst::Create(headB, stepB);
+    if (step) step->EmitValue();
+    llvm::BranchInst::Create(headB, irgen->GetBasicBlock());
     irgen->SetBasicBlock(footB);
     breakBB->pop_back();
     continueBB->pop_back();
@@ -172,36 +410,46 @@ void WhileStmt::PrintChildren(int indentLevel) {
     body->Print(indentLevel+1, "(body) ");
 }
 
-llvm::Value* WhileStmt::Emit() {
-    llvm::Twine *testTwine = new llvm::Twine("test");
-    llvm::Twine *footerTwine = new llvm::Twine("footer");
-    llvm::Twine *bodyTwine = new llvm::Twine("body");
+void WhileStmt::Check() {
+    test->Check();
     symTable->push();
+    body->Check();
+    symTable->pop();
+}
 
-    if (irgen->GetBasicBlock()->getTerminator() == NULL) 
-        llvm::BranchInst::Create(llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction()), irgen->GetBasicBlock());
-
-    llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction())->moveAfter(irgen->GetBasicBlock());
+Stmt *WhileStmt::Fold() {
+    (test=test->Fold())->SetParent(this);
+    (body=body->Fold())->SetParent(this);
 
-    irgen->SetBasicBlock(llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction()));
+    BoolConstant *c = dynamic_cast<BoolConstant*>(test);
+    if (c != NULL && !c->GetValue())
+        return NoStmt();
+    return this;
+}
 
-    if (llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction())->getTerminator() == NULL) 
-        llvm::BranchInst::Create(llvm::BasicBlock::Create(*irgen->GetContext(), *bodyTwine, irgen->GetFunction()), llvm::BasicBlock::Create(*irgen->GetContext(), *footerTwine, irgen->GetFunction()), test->Emit(), llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction()));
+llvm::Value* WhileStmt::Emit() {
+    llvm::LLVMContext *c = irgen->GetContext();
+    llvm::Function* f = irgen->GetFunction();
+    llvm::BasicBlock *headB = llvm::BasicBlock::Create(*c, "head", f);
+    llvm::BasicBlock *bodyB = llvm::BasicBlock::Create(*c, "body", f);
+    llvm::BasicBlock *footB = llvm::BasicBlock::Create(*c, "foot", f);
 
-    llvm::BasicBlock::Create(*irgen->GetContext(), *bodyTwine, irgen->GetFunction())->moveAfter(llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction()));
-    irgen->SetBasicBlock(llvm::BasicBlock::Create(*irgen->GetContext(), *bodyTwine, irgen->GetFunction()));
+    // as in ForStmt::Emit, the test and body are closed in whichever
+    // block they ended in; continue goes back to the test
+    llvm::BranchInst::Create(headB, irgen->GetBasicBlock());
+    irgen->SetBasicBlock(headB);
+    llvm::Value* value = test->EmitValue();
+    llvm::BranchInst::Create(bodyB, footB, value, irgen->GetBasicBlock());
+    breakBB->push_back(footB);
+    continueBB->push_back(headB);
+    irgen->SetBasicBlock(bodyB);
     body->Emit();
-
-    if(llvm::BasicBlock::Create(*irgen->GetContext(), *bodyTwine, irgen->GetFunction())->getTerminator() == NULL) 
-        llvm::BranchInst::Create(llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction()), llvm::BasicBlock::Create(*irgen->GetContext(), *bodyTwine, irgen->GetFunction()));
-
-    llvm::BasicBlock::Create(*irgen->GetContext(), *footerTwine, irgen->GetFunction())->moveAfter(irgen->GetBasicBlock());
-
-    if(irgen->GetBasicBlock()->getTerminator() == NULL)
-        llvm::BranchInst::Create(llvm::BasicBlock::Create(*irgen->GetContext(), *testTwine, irgen->GetFunction()), irgen->GetBasicBlock());
-
-    irgen->SetBasicBlock(llvm::BasicBlock::Create(*irgen->GetContext(), *footerTwine, irgen->GetFunction()));
-    symTable->pop();
+    if (!irgen->GetBasicBlock()->getTerminator())
+        llvm::BranchInst::Create(headB, irgen->GetBasicBlock());
+    irgen->SetBasicBlock(footB);
+    breakBB->pop_back();
+    continueBB->pop_back();
+    return NULL;
 }
 
 IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb): ConditionalStmt(t, tb) { 
@@ -216,6 +464,37 @@ void IfStmt::PrintChildren(int indentLevel) {
     if (elseBody) elseBody->Print(indentLevel+1, "(else) ");
 }
 
+void IfStmt::Check() {
+    test->Check();
+    symTable->push();
+    body->Check();
+    symTable->pop();
+    if (elseBody) {
+        symTable->push();
+        elseBody->Check();
+        symTable->pop();
+    }
+}
+
+Stmt *IfStmt::Fold() {
+    (test=test->Fold())->SetParent(this);
+    (body=body->Fold())->SetParent(this);
+    if (elseBody) (elseBody=elseBody->Fold())->SetParent(this);
+
+    if (BoolConstant *c = dynamic_cast<BoolConstant*>(test)) {
+        if (c->GetValue()) {
+            Expr::numFolded++;
+            return body;
+        }
+        if (elseBody) {
+            Expr::numFolded++;
+            return elseBody;
+        }
+        return NoStmt();
+    }
+    return this;
+}
+
 llvm::Value* IfStmt::Emit() {
     /* 
     symTable->push();
@@ -267,29 +546,34 @@ llvm::Value* IfStmt::Emit() {
 */
   llvm::Function *function = irgen->GetFunction();
   llvm::LLVMContext *c = irgen->GetContext();
-  llvm::Value* valueB = test->Emit();
+  llvm::Value* valueB = test->EmitValue();
   llvm::BasicBlock* footB = llvm::BasicBlock::Create(*c, "Foot", function);
   llvm::BasicBlock* elseB = NULL;
   if(elseBody != NULL)
     elseB = llvm::BasicBlock::Create(*c, "else", function);
   llvm::BasicBlock* thenB = llvm::BasicBlock::Create(*c, "then", function);
   llvm::BranchInst::Create(thenB,elseBody?elseB:footB,valueB, irgen->GetBasicBlock());
-  symTable->push();
   irgen->SetBasicBlock(thenB);
   body->Emit();
-  symTable->pop();
-  llvm::BranchInst::Create(footB, thenB);
+  if (!irgen->GetBasicBlock()->getTerminator())
+    llvm::BranchInst::Create(footB, irgen->GetBasicBlock());
   if (elseBody != NULL) {
 
-    symTable->push();
     irgen->SetBasicBlock(elseB);
     elseBody->Emit();
-    llvm::BranchInst::Create(footB, elseB);
-    symTable->pop();
-    irgen->SetBasicBlock(footB);
+    if (!irgen->GetBasicBlock()->getTerminator())
+      llvm::BranchInst::Create(footB, irgen->GetBasicBlock());
   }
 
+  // when both arms return or break, nothing reaches the footer and the
+  // statements after the if are dead; staying in the terminated block
+  // makes the enclosing block skip them
+  if (footB->use_empty()) {
+    footB->eraseFromParent();
     return NULL;
+  }
+  irgen->SetBasicBlock(footB);
+  return NULL;
 }
 
 ReturnStmt::ReturnStmt(yyltype loc, Expr *e) : Stmt(loc) { 
@@ -302,9 +586,18 @@ void ReturnStmt::PrintChildren(int indentLevel) {
       expr->Print(indentLevel+1);
 }
 
+void ReturnStmt::Check() {
+    if (expr) expr->Check();
+}
+
+Stmt *ReturnStmt::Fold() {
+    if (expr) (expr=expr->Fold())->SetParent(this);
+    return this;
+}
+
 llvm::Value* ReturnStmt::Emit() {
     if (expr ) {
-        llvm::Value* rval = expr->Emit();
+        llvm::Value* rval = expr->EmitValue();
         llvm::ReturnInst::Create(*irgen->GetContext(), rval, irgen->GetBasicBlock());
     }
 
@@ -332,6 +625,17 @@ void SwitchLabel::PrintChildren(int indentLevel) {
     if (stmt)  stmt->Print(indentLevel+1);
 }
 
+void SwitchLabel::Check() {
+    if (label) label->Check();
+    if (stmt) stmt->Check();
+}
+
+Stmt *SwitchLabel::Fold() {
+    if (label) (label=label->Fold())->SetParent(this);
+    if (stmt) (stmt=stmt->Fold())->SetParent(this);
+    return this;
+}
+
 SwitchStmt::SwitchStmt(Expr *e, List<Stmt *> *c, Default *d) {
     Assert(e != NULL && c != NULL && c->NumElements() != 0 );
     (expr=e)->SetParent(this);
@@ -347,30 +651,95 @@ void SwitchStmt::PrintChildren(int indentLevel) {
 }
 
 
-llvm::Value* SwitchStmt::Emit() {
-    int i =0;
-    while (i < cases->NumElements()) {
-        if (dynamic_cast<Case*>(cases->Nth(i))) {
-             irgen->SetBasicBlock(llvm::BasicBlock::Create(*irgen->GetContext(), "case", irgen->GetFunction()));
-             llvm::BranchInst::Create(llvm::BasicBlock::Create(*irgen->GetContext(), "case", irgen->GetFunction()), irgen->GetBasicBlock());
-             cases->Nth(i)->Emit();
+void SwitchStmt::Check() {
+    expr->Check();
+    Type *t = expr->type;
+    if (!t->IsError() && t != Type::intType && t != Type::uintType)
+        ReportError::Formatted(expr->GetLocation(), "switch expression must be a scalar integer");
+    for (int i = 0; i < cases->NumElements(); i++)
+        cases->Nth(i)->Check();
+    if (def) def->Check();
+}
+
+Stmt *SwitchStmt::Fold() {
+    (expr=expr->Fold())->SetParent(this);
+    for (int i = 0; i < cases->NumElements(); i++) {
+        cases->SetNth(i, cases->Nth(i)->Fold());
+        cases->Nth(i)->SetParent(this);
+    }
+    if (def) def->Fold();
+
+    // labels are only known to be constants once folded, so they are
+    // validated here, on the compiling thread, rather than in Emit
+    std::set<int> seen;
+    for (int i = 0; i <= cases->NumElements(); i++) {
+        Stmt *stmt = (i < cases->NumElements()? cases->Nth(i) : def);
+        while (SwitchLabel *label = dynamic_cast<SwitchLabel*>(stmt)) {
+            Expr *e = label->returnLabel();
+            IntConstant *k = dynamic_cast<IntConstant*>(e);
+            if (e != NULL && k == NULL)
+                ReportError::Formatted(e->GetLocation(), "case label must be a constant integer expression");
+            else if (k != NULL && !seen.insert(k->GetValue()).second)
+                ReportError::Formatted(e->GetLocation(), "duplicate case label %d", k->GetValue());
+            stmt = label->returnStmt();
         }
+    }
+    return this;
+}
 
-        else if (dynamic_cast<Default*>(cases->Nth(i))) {
-       
-             irgen->SetBasicBlock(llvm::BasicBlock::Create(*irgen->GetContext(), "default", irgen->GetFunction()));
-             llvm::BranchInst::Create(llvm::BasicBlock::Create(*irgen->GetContext(), "default", irgen->GetFunction()), irgen->GetBasicBlock());
-             cases->Nth(i)->Emit();
+/* Method: Emit
+ * ------------
+ * Lowers the switch to a single SwitchInst on the value of expr, so LLVM
+ * can turn dense labels into a jump table. Each case or default label
+ * starts a block of its own; a label whose statement is itself a label
+ * (case 1: case 2: ...) shares that block. Statements run on into the
+ * next label's block unless they end in a break, which branches to the
+ * block after the switch through breakBB. Without a default, values that
+ * match no label go straight to that block too. Check and Fold have
+ * already rejected bad labels and switch values, so nothing is reported
+ * here, where -j may have the function on a worker thread.
+ */
+llvm::Value* SwitchStmt::Emit() {
+    llvm::LLVMContext *c = irgen->GetContext();
+    llvm::Function *f = irgen->GetFunction();
+    llvm::Value *value = expr->EmitValue();
+    llvm::IntegerType *intTy = llvm::cast<llvm::IntegerType>(value->getType());
+
+    llvm::BasicBlock *footB = llvm::BasicBlock::Create(*c, "switch_foot", f);
+    llvm::SwitchInst *sw = llvm::SwitchInst::Create(value, footB, cases->NumElements(),
+                                                    irgen->GetBasicBlock());
+    breakBB->push_back(footB);
 
+    for (int i = 0; i <= cases->NumElements(); i++) {
+        Stmt *stmt = (i < cases->NumElements()? cases->Nth(i) : def);
+        if (stmt == NULL)
+            continue;
+
+        if (dynamic_cast<SwitchLabel*>(stmt) != NULL) {
+            llvm::BasicBlock *caseB = llvm::BasicBlock::Create(*c, "case", f, footB);
+            if (!irgen->GetBasicBlock()->getTerminator())
+                llvm::BranchInst::Create(caseB, irgen->GetBasicBlock());   // fall through
+            irgen->SetBasicBlock(caseB);
+
+            while (SwitchLabel *label = dynamic_cast<SwitchLabel*>(stmt)) {
+                IntConstant *k = dynamic_cast<IntConstant*>(label->returnLabel());
+                if (k == NULL)
+                    sw->setDefaultDest(caseB);
+                else
+                    sw->addCase(llvm::ConstantInt::get(intTy, k->GetValue()), caseB);
+                stmt = label->returnStmt();
+            }
         }
-	i++;
-    }
 
-    if (llvm::BasicBlock::Create(*irgen->GetContext(), "default", irgen->GetFunction())->getTerminator() == NULL) {
-        llvm::BranchInst::Create(llvm::BasicBlock::Create(*irgen->GetContext(), "footer", irgen->GetFunction()), llvm::BasicBlock::Create(*irgen->GetContext(), "default", irgen->GetFunction()));
+        // as in a block, statements after a break or return are never reached
+        if (!irgen->GetBasicBlock()->getTerminator())
+            stmt->Emit();
     }
 
-    irgen->SetBasicBlock(llvm::BasicBlock::Create(*irgen->GetContext(), "footer", irgen->GetFunction()));
+    if (!irgen->GetBasicBlock()->getTerminator())
+        llvm::BranchInst::Create(footB, irgen->GetBasicBlock());
+    breakBB->pop_back();
+    irgen->SetBasicBlock(footB);
     return NULL;
 }
 
@@ -13,9 +13,11 @@
 #ifndef _H_ast_stmt
 #define _H_ast_stmt
 
+#include <string>
 #include "list.h"
 #include "ast.h"
 
+class CompileCache;
 class Decl;
 class VarDecl;
 class Expr;
@@ -27,11 +29,16 @@ class Program : public Node
 {
   protected:
      List<Decl*> *decls;
+     int numGlobals;  // global slots assigned by Check()
+
+     unsigned EmitFunctionsSeparately(CompileCache *cache, const vector<std::string> *keys);
      
   public:
      Program(List<Decl*> *declList);
      const char *GetPrintNameForNode() { return "Program"; }
      void PrintChildren(int indentLevel);
+     void Check();
+     void Fold();
      llvm::Value* Emit();
 };
 
@@ -40,6 +47,11 @@ class Stmt : public Node
   public:
      Stmt() : Node() {}
      Stmt(yyltype loc) : Node(loc) {}
+
+     // Folds the constant expressions in the statement and returns what
+     // should replace it: if (true) A else B folds to A, while (false) to
+     // nothing at all.
+     virtual Stmt *Fold() { return this; }
 };
 
 class StmtBlock : public Stmt 
@@ -52,6 +64,8 @@ class StmtBlock : public Stmt
     StmtBlock(List<VarDecl*> *variableDeclarations, List<Stmt*> *statements);
     const char *GetPrintNameForNode() { return "StmtBlock"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Stmt *Fold();
     llvm::Value* Emit();
 };
 
@@ -64,6 +78,7 @@ class DeclStmt: public Stmt
     DeclStmt(Decl *d);
     const char *GetPrintNameForNode() { return "DeclStmt"; }
     void PrintChildren(int indentLevel);
+    void Check();
     llvm::Value* Emit();
 };
   
@@ -95,6 +110,8 @@ class ForStmt : public LoopStmt
     ForStmt(Expr *init, Expr *test, Expr *step, Stmt *body);
     const char *GetPrintNameForNode() { return "ForStmt"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Stmt *Fold();
     llvm::Value* Emit();
 };
 
@@ -104,6 +121,8 @@ class WhileStmt : public LoopStmt
     WhileStmt(Expr *test, Stmt *body) : LoopStmt(test, body) {}
     const char *GetPrintNameForNode() { return "WhileStmt"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Stmt *Fold();
     llvm::Value* Emit();
 };
 
@@ -117,6 +136,8 @@ class IfStmt : public ConditionalStmt
     IfStmt(Expr *test, Stmt *thenBody, Stmt *elseBody);
     const char *GetPrintNameForNode() { return "IfStmt"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Stmt *Fold();
     llvm::Value* Emit();
 
 };
@@ -154,6 +175,8 @@ class ReturnStmt : public Stmt
     ReturnStmt(yyltype loc, Expr *expr = NULL);
     const char *GetPrintNameForNode() { return "ReturnStmt"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Stmt *Fold();
     llvm::Value* Emit();
 
 };
@@ -169,7 +192,10 @@ class SwitchLabel : public Stmt
     SwitchLabel(Expr *label, Stmt *stmt);
     SwitchLabel(Stmt *stmt);
     void PrintChildren(int indentLevel);
+    void Check();
+    Stmt *Fold();
     Expr* returnLabel() { return label; }
+    Stmt* returnStmt() { return stmt; }
 };
 
 class Case : public SwitchLabel
@@ -199,6 +225,8 @@ class SwitchStmt : public Stmt
     SwitchStmt(Expr *expr, List<Stmt*> *cases, Default *def);
     virtual const char *GetPrintNameForNode() { return "SwitchStmt"; }
     void PrintChildren(int indentLevel);
+    void Check();
+    Stmt *Fold();
     llvm::Value* Emit();
 };
 
@@ -61,13 +61,12 @@ void TypeQualifier::PrintChildren(int indentLevel) {
 }
 
 bool Type::IsNumeric() { 
-    return this->IsEquivalentTo(Type::intType) || this->IsEquivalentTo(Type::floatType);
+    return this->IsEquivalentTo(Type::intType) || this->IsEquivalentTo(Type::uintType) ||
+           this->IsEquivalentTo(Type::floatType);
 }
 
 bool Type::IsVector() { 
-    return this->IsEquivalentTo(Type::vec2Type) || 
-           this->IsEquivalentTo(Type::vec3Type) ||  
-           this->IsEquivalentTo(Type::vec4Type);
+    return this->NumComponents() > 1 && !this->IsMatrix();
 }
 
 bool Type::IsMatrix() { 
@@ -79,6 +78,55 @@ bool Type::IsMatrix() {
 bool Type::IsError() { 
     return this->IsEquivalentTo(Type::errorType);
 }
+
+bool Type::IsIntegral() {
+    Type *c = this->IsVector() ? this->ComponentType() : this;
+    return c == Type::intType || c == Type::uintType || c == Type::boolType;
+}
+
+int Type::NumComponents() {
+    if (this == vec2Type || this == ivec2Type || this == uvec2Type ||
+        this == bvec2Type || this == mat2Type)
+        return 2;
+    if (this == vec3Type || this == ivec3Type || this == uvec3Type ||
+        this == bvec3Type || this == mat3Type)
+        return 3;
+    if (this == vec4Type || this == ivec4Type || this == uvec4Type ||
+        this == bvec4Type || this == mat4Type)
+        return 4;
+    return 1;
+}
+
+Type *Type::ComponentType() {
+    if (this == vec2Type || this == vec3Type || this == vec4Type)
+        return floatType;
+    if (this == ivec2Type || this == ivec3Type || this == ivec4Type)
+        return intType;
+    if (this == uvec2Type || this == uvec3Type || this == uvec4Type)
+        return uintType;
+    if (this == bvec2Type || this == bvec3Type || this == bvec4Type)
+        return boolType;
+    if (this == mat2Type) return vec2Type;
+    if (this == mat3Type) return vec3Type;
+    if (this == mat4Type) return vec4Type;
+    return this;
+}
+
+Type *Type::VectorOf(Type *component, int n) {
+    if (n == 1) return component;
+    if (n < 2 || n > 4) return errorType;
+
+    Type *vecs[]  = { vec2Type,  vec3Type,  vec4Type  };
+    Type *ivecs[] = { ivec2Type, ivec3Type, ivec4Type };
+    Type *uvecs[] = { uvec2Type, uvec3Type, uvec4Type };
+    Type *bvecs[] = { bvec2Type, bvec3Type, bvec4Type };
+
+    if (component == floatType) return vecs[n-2];
+    if (component == intType)   return ivecs[n-2];
+    if (component == uintType)  return uvecs[n-2];
+    if (component == boolType)  return bvecs[n-2];
+    return errorType;
+}
 	
 NamedType::NamedType(Identifier *i) : Type(*i->GetLocation()) {
     Assert(i != NULL);
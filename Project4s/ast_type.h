@@ -61,6 +61,16 @@ class Type : public Node
     bool IsVector();
     bool IsMatrix();
     bool IsError();
+
+    // Shape queries used by the type-annotation pass and by codegen.
+    // NumComponents is the lane count of a vector or the column count of
+    // a matrix (1 for scalars); ComponentType is the scalar type of a
+    // vector or the column type of a matrix. IsIntegral is true for every
+    // type lowered to LLVM integers (int, uint, bool and their vectors).
+    bool IsIntegral();
+    int NumComponents();
+    Type *ComponentType();
+    static Type *VectorOf(Type *component, int n);
     //const char *getName() {return typeName;}
 };
 
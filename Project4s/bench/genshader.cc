@@ -0,0 +1,124 @@
+/**
+ * File: bench/genshader.cc
+ * ------------------------
+ * Writes a synthetic GLSL program to stdout for compile-time scaling
+ * runs (bench/scaling.sh). Each kind stresses one dimension, and size
+ * grows it linearly:
+ *
+ *   expr       one expression of size operators, nested left-deep
+ *   assign     a chain of size assignments, a0 = a1 = ... = x
+ *   globals    size globals, all read by one function
+ *   functions  size small functions, each with a loop over a global
+ *   scopes     size nested blocks, each shadowing the same name
+ *   switch     a switch with size cases
+ *   loops      size nested loops, alternately for and while
+ *
+ * Every program defines "int entry(int x)" so it can also be run, which
+ * scaling.sh does at a small size before timing a kind. The loops kind
+ * runs 2^size iterations, so only small sizes are worth running.
+ *
+ * Usage: genshader <kind> <size>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void Expr(int n) {
+    printf("int entry(int x)\n{\n   int r;\n   r = x");
+    const char *ops[] = { " + ", " * ", " - " };
+    for (int i = 0; i < n; i++)
+        printf("%s%d", ops[i % 3], i % 7 + 1);
+    printf(";\n   return r;\n}\n");
+}
+
+static void Assign(int n) {
+    printf("int entry(int x)\n{\n");
+    for (int i = 0; i < n; i++)
+        printf("   int a%d;\n", i);
+    printf("   ");
+    for (int i = 0; i < n; i++)
+        printf("a%d = ", i);
+    printf("x;\n   return a0;\n}\n");
+}
+
+static void Globals(int n) {
+    for (int i = 0; i < n; i++)
+        printf("int g%d;\n", i);
+    printf("\nint entry(int x)\n{\n   int s;\n   s = x;\n");
+    for (int i = 0; i < n; i++)
+        printf("   s = s + g%d;\n", i);
+    printf("   return s;\n}\n");
+}
+
+static void Functions(int n) {
+    printf("int g;\n\n");
+    for (int i = 0; i < n; i++) {
+        printf("int f%d(int x)\n{\n   int i;\n   int s;\n   s = x;\n", i);
+        printf("   for (i = 0; i < %d; i++) {\n      s = s + g * %d;\n   }\n", i % 5 + 1, i);
+        printf("   return s;\n}\n\n");
+    }
+    printf("int entry(int x)\n{\n   return x + g;\n}\n");
+}
+
+static void Scopes(int n) {
+    printf("int entry(int x)\n{\n   int r;\n   r = 0;\n");
+    for (int i = 0; i < n; i++)
+        printf("%*s{ int v; v = x + %d; r = r + v;\n", 3 + i % 60, "", i);
+    for (int i = n - 1; i >= 0; i--)
+        printf("%*s}\n", 3 + i % 60, "");
+    printf("   return r;\n}\n");
+}
+
+static void Switch(int n) {
+    printf("int entry(int x)\n{\n   int r;\n   r = 0;\n   switch (x) {\n");
+    for (int i = 0; i < n; i++)
+        printf("   case %d:\n      r = r + %d;\n      break;\n", i, i * 3 + 1);
+    printf("   default:\n      r = -1;\n   }\n   return r;\n}\n");
+}
+
+static void Loops(int n) {
+    printf("int entry(int x)\n{\n   int s;\n");
+    for (int i = 0; i < n; i++)
+        printf("   int i%d;\n", i);
+    printf("   s = 0;\n");
+    for (int i = 0; i < n; i++) {
+        if (i % 2 == 0)
+            printf("%*sfor (i%d = 0; i%d < 2; i%d++) {\n", 3 + i % 60, "", i, i, i);
+        else
+            printf("%*si%d = 0;\n%*swhile (i%d < 2) {\n%*s   i%d++;\n", 3 + i % 60, "", i,
+                   3 + i % 60, "", i, 3 + i % 60, "", i);
+    }
+    printf("%*ss = s + x;\n", 3 + n % 60, "");
+    for (int i = n - 1; i >= 0; i--)
+        printf("%*s}\n", 3 + i % 60, "");
+    printf("   return s;\n}\n");
+}
+
+struct Kind {
+    const char *name;
+    void (*generate)(int size);
+};
+
+static const Kind Kinds[] = {
+    { "expr", Expr }, { "assign", Assign }, { "globals", Globals },
+    { "functions", Functions }, { "scopes", Scopes }, { "switch", Switch },
+    { "loops", Loops },
+};
+
+int main(int argc, char *argv[]) {
+    int size = argc == 3 ? atoi(argv[2]) : 0;
+    for (size_t k = 0; size > 0 && k < sizeof(Kinds) / sizeof(Kinds[0]); k++) {
+        if (!strcmp(argv[1], Kinds[k].name)) {
+            printf("// genshader %s %d\n", argv[1], size);
+            Kinds[k].generate(size);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "Usage: genshader <kind> <size>\nkinds:");
+    for (size_t k = 0; k < sizeof(Kinds) / sizeof(Kinds[0]); k++)
+        fprintf(stderr, " %s", Kinds[k].name);
+    fprintf(stderr, "\n");
+    return 2;
+}
@@ -0,0 +1,49 @@
+#!/bin/bash
+#
+# Compares glc's optimization levels on the tests/ corpus. For each of
+# -O0 .. -O3 every test is compiled, the instruction counts reported by
+# -d optstats are summed, and each test is run with glc --run against
+# its .dat (REPS times) to get total runtime and check the output still
+# matches the .out. For steady-state ns/call see bench/runtime.sh.
+#
+# Usage: bench/optlevels.sh [REPS]     (run from Project4s, needs ./glc)
+
+REPS=${1:-5}
+
+[ -x glc ] || { echo "Error: glc not executable"; exit 1; }
+
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+now() { date +%s.%N; }
+
+printf "%-5s %12s %12s %10s %8s\n" level emitted optimized "run (s)" failed
+for level in 0 1 2 3; do
+    emitted=0
+    optimized=0
+    failed=0
+    for src in tests/*.glsl; do
+        name=$(basename ${src%.glsl})
+        stats=$(./glc -O$level -d optstats < $src 2>&1 >$WORK/$name.bc | grep '^optstats:')
+        set -- $stats
+        emitted=$((emitted + $3))
+        optimized=$((optimized + $6))
+    done
+
+    start=$(now)
+    for src in tests/*.glsl; do
+        name=$(basename ${src%.glsl})
+        dat=${src%.glsl}.dat
+        [ -f $dat ] || continue
+        for ((r = 0; r < REPS; r++)); do
+            ./glc -O$level --run $dat < $src > $WORK/$name.myout 2>/dev/null
+        done
+        if [ -f ${src%.glsl}.out ] && ! cmp -s $WORK/$name.myout ${src%.glsl}.out; then
+            failed=$((failed + 1))
+        fi
+    done
+    end=$(now)
+
+    printf "%-5s %12d %12d %10.3f %8d\n" -O$level $emitted $optimized \
+        $(awk "BEGIN { print $end - $start }") $failed
+done
@@ -0,0 +1,65 @@
+#!/bin/bash
+#
+# Measures the speed of the code glc generates. Every test in tests/ and
+# samples/ that has a .dat file is JIT compiled at -O0 .. -O3 with
+# glc --run --bench, which calls the .dat's entry point a number of times
+# per sample with its gin inputs and reports the mean ns/call with a 95%
+# confidence interval. The table lists each test per level, and the last
+# line the geometric mean over all tests, so a codegen change can be
+# judged by one number per level.
+#
+# The number of calls is calibrated per test and level: a one-call probe
+# measures the cost of a call, and each sample is then sized to take
+# about SAMPLE_MS milliseconds, capped at CALLS. A test that loops a
+# million times per call so gets a handful of calls, not CALLS of them.
+#
+# Usage: bench/runtime.sh [CALLS] [TEST...]   (run from Project4s, needs ./glc)
+#        CALLS caps the calls per sample and defaults to 1000000; TESTs
+#        are .glsl paths, all by default. SAMPLE_MS defaults to 50.
+
+CALLS=${1:-1000000}
+SAMPLE_MS=${SAMPLE_MS:-50}
+shift
+TESTS=${*:-$(ls tests/*.glsl samples/*.glsl)}
+
+[ -x glc ] || { echo "Error: glc not executable"; exit 1; }
+
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+printf "%-40s" test
+for level in 0 1 2 3; do printf " %20s" "-O$level ns/call"; done
+printf "\n"
+
+for src in $TESTS; do
+    dat=${src%.glsl}.dat
+    [ -f $dat ] || continue
+    name=$(basename $(dirname $src))/$(basename ${src%.glsl})
+    printf "%-40s" $name
+    for level in 0 1 2 3; do
+        line=$(./glc -O$level --run $dat --bench 1 < $src 2>/dev/null | grep '^Bench:')
+        if [ -n "$line" ]; then
+            set -- $line
+            calls=$(awk -v ns=$2 -v ms=$SAMPLE_MS -v max=$CALLS \
+                'BEGIN { n = (ns > 0) ? int(ms * 1e6 / ns) : max;
+                         if (n > max) n = max; if (n < 1) n = 1; print n }')
+            line=$(./glc -O$level --run $dat --bench $calls < $src 2>/dev/null | grep '^Bench:')
+        fi
+        if [ -z "$line" ]; then
+            printf " %20s" failed
+            continue
+        fi
+        set -- $line
+        printf " %11.3f +- %5.3f" $2 $5
+        echo "$level $2" >> $WORK/results
+    done
+    printf "\n"
+done
+
+[ -f $WORK/results ] || exit 0
+printf "%-40s" "geometric mean"
+for level in 0 1 2 3; do
+    awk -v l=$level '$1 == l && $2 > 0 { s += log($2); n++ }
+        END { if (n) printf " %20.3f", exp(s / n); else printf " %20s", "-" }' $WORK/results
+done
+printf "\n"
@@ -0,0 +1,54 @@
+#!/bin/bash
+#
+# Measures how glc's compile time and memory grow with program size. For
+# each kind of stress program bench/genshader can write, the size is
+# doubled from START up to MAX; each program is compiled once with
+# --timing-json and the wall time and peak RSS are reported, along with
+# the growth exponent against the previous size (time ~ size^k: 1 is
+# linear, 2 quadratic; a figure that keeps climbing as sizes double means
+# worse than polynomial). Before a kind is timed, a small program of
+# that kind is run with glc --run; a kind whose code does not run is
+# reported as "bad code" and skipped, so the table never times a broken
+# lowering.
+#
+# Usage: bench/scaling.sh [KIND...]     (run from Project4s, needs ./glc)
+#        START, MAX and OPT (default -O0) may be set in the environment.
+
+START=${START:-125}
+MAX=${MAX:-4000}
+OPT=${OPT:--O0}
+KINDS=${*:-expr assign globals functions scopes switch loops}
+
+[ -x glc ] || { echo "Error: glc not executable"; exit 1; }
+make -s bench/genshader || exit 1
+
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+printf "funct: entry\nparam: int, 1\n" > $WORK/entry.dat
+
+field() { sed -n "s/.*\"$1\": \([0-9.]*\).*/\1/p" $WORK/t.json | head -1; }
+
+printf "%-10s %7s %10s %10s %10s %6s\n" kind size "wall ms" "peak KB" "glsl KB" k
+for kind in $KINDS; do
+    prev=
+    bench/genshader $kind 10 > $WORK/p.glsl
+    if ! ./glc --run $WORK/entry.dat < $WORK/p.glsl 2>/dev/null | grep -q '^Result:'; then
+        printf "%-10s %7d %10s\n" $kind 10 "bad code"
+        continue
+    fi
+    for ((size = START; size <= MAX; size *= 2)); do
+        bench/genshader $kind $size > $WORK/p.glsl
+        rm -f $WORK/t.json
+        if ! ./glc $OPT --timing-json $WORK/t.json < $WORK/p.glsl > /dev/null 2>&1; then
+            printf "%-10s %7d %10s\n" $kind $size failed
+            break
+        fi
+        wall=$(field wall_ms)
+        rss=$(field peak_rss_kb)
+        kb=$(( $(wc -c < $WORK/p.glsl) / 1024 ))
+        k=$(awk "BEGIN { if (\"$prev\" != \"\" && $prev > 0) printf \"%.2f\", log($wall / $prev) / log(2); else print \"-\" }")
+        printf "%-10s %7d %10.1f %10d %10d %6s\n" $kind $size $wall $rss $kb $k
+        prev=$wall
+    done
+done
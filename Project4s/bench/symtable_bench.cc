@@ -0,0 +1,96 @@
+/**
+ * File: bench/symtable_bench.cc
+ * -----------------------------
+ * Microbenchmark for SymbolTable. Two workloads:
+ *
+ *   nest  - pushes 10,000 nested scopes, declaring and looking up one
+ *           name per level (each shadowing the last), then unwinds them.
+ *   wide  - declares 100,000 distinct symbols in one scope and looks
+ *           every one of them up from inside a few inner scopes.
+ *
+ * Usage: symtable_bench [repetitions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../symtable.h"
+
+static const int NestDepth = 10000;
+static const int WideSymbols = 100000;
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Symbol *MakeSymbols(int n, const char *prefix) {
+    Symbol *syms = new Symbol[n];
+    char buf[32];
+    for (int i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+        syms[i] = Interner::Intern(buf);
+    }
+    return syms;
+}
+
+static long Nest(Symbol *names, int nnames) {
+    SymbolTable table;
+    long found = 0;
+    table.push();
+    for (int d = 0; d < NestDepth; d++) {
+        table.push();
+        values v = { d, NULL, NULL };
+        table.addSym(make_pair(names[d % nnames], v));
+        for (int k = 0; k < nnames; k++)
+            found += table.lookupValue(names[k]).flag != -1;
+    }
+    for (int d = 0; d < NestDepth; d++)
+        table.pop();
+    table.pop();
+    return found;
+}
+
+static long Wide(Symbol *names) {
+    SymbolTable table;
+    long found = 0;
+    table.push();
+    for (int i = 0; i < WideSymbols; i++) {
+        values v = { i, NULL, NULL };
+        table.addSym(make_pair(names[i], v));
+    }
+    for (int d = 0; d < 4; d++) {
+        table.push();
+        for (int i = 0; i < WideSymbols; i++)
+            found += table.lookupValue(names[i]).flag == i;
+        table.pop();
+    }
+    table.pop();
+    return found;
+}
+
+int main(int argc, char *argv[]) {
+    int reps = argc > 1 ? atoi(argv[1]) : 5;
+    Symbol *nestNames = MakeSymbols(16, "n");
+    Symbol *wideNames = MakeSymbols(WideSymbols, "w");
+
+    double best[2] = { 1e30, 1e30 };
+    long checksum = 0;
+    for (int r = 0; r < reps; r++) {
+        double t0 = Now();
+        checksum += Nest(nestNames, 16);
+        double t1 = Now();
+        checksum += Wide(wideNames);
+        double t2 = Now();
+        if (t1 - t0 < best[0]) best[0] = t1 - t0;
+        if (t2 - t1 < best[1]) best[1] = t2 - t1;
+    }
+
+    printf("nest  %6d scopes   %8.3f ms\n", NestDepth, best[0] * 1e3);
+    printf("wide  %6d symbols  %8.3f ms\n", WideSymbols, best[1] * 1e3);
+    printf("checksum %ld\n", checksum);
+    delete[] nestNames;
+    delete[] wideNames;
+    return 0;
+}
@@ -0,0 +1,280 @@
+/* File: cache.cc
+ * --------------
+ * Implementation of the on-disk compile cache.
+ */
+
+#include "cache.h"
+#include "scanner.h"
+#include "errors.h"
+#include "utility.h"
+#include "parser.h"  // for token codes
+#include "timing.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/MD5.h"
+
+using namespace std;
+
+// Bumped whenever the layout of keys or entries changes.
+static const char *CacheFormat = "glc-cache-1";
+
+// Eviction scans the directory, so a process only does it every so often.
+static const int StoresPerEviction = 32;
+
+/* Identifies the compiler that produced an entry. Besides the LLVM
+ * version it uses the size and mtime of the glc binary, so rebuilding
+ * glc after any change retires everything the old build cached. */
+static string CompilerIdentity() {
+    ostringstream id;
+    id << CacheFormat << ' ' << LLVM_VERSION_STRING;
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0)
+        id << ' ' << (long long)st.st_size << ' ' << (long long)st.st_mtime;
+    return id.str();
+}
+
+CompileCache::CompileCache(const char *d, unsigned long long max) :
+    dir(d), maxBytes(max), storesSinceEvict(StoresPerEviction)
+{
+    if (mkdir(d, 0777) != 0 && errno != EEXIST)
+        ReportError::Formatted(NULL, "Cannot create cache directory %s: %s", d, strerror(errno));
+}
+
+static void HashTokens(llvm::MD5 &hash, const vector<ScannedToken> &tokens,
+                       size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        hash.update(llvm::StringRef((const char *)&tokens[i].code, sizeof(int)));
+        hash.update(tokens[i].text);
+        hash.update(llvm::StringRef("", 1));
+    }
+}
+
+static string Finish(llvm::MD5 &hash) {
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> key;
+    llvm::MD5::stringifyResult(result, key);
+    return key.str().str();
+}
+
+/* A top-level declaration as a run of tokens: it ends at a semicolon or
+ * at the brace closing a function body, outside any braces. */
+struct DeclSpan {
+    size_t begin, end;
+    string name;             // the identifier it declares
+    vector<int> uses;        // other declarations it names
+};
+
+static void SplitDecls(const vector<ScannedToken> &tokens, vector<DeclSpan> &decls) {
+    int depth = 0;
+    DeclSpan span;
+    span.begin = 0;
+    bool named = false;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        int code = tokens[i].code;
+        // the declared name is the last identifier before the parameter
+        // list, initializer, array bound or end of the declaration
+        if (depth == 0 && !named) {
+            if (code == T_Identifier)
+                span.name = tokens[i].text;
+            else if (code == T_LeftParen || code == T_Equal || code == T_LeftBracket ||
+                     code == T_Semicolon)
+                named = true;
+        }
+        if (code == T_LeftBrace)
+            depth++;
+        else if (code == T_RightBrace)
+            depth--;
+        if (depth == 0 && (code == T_Semicolon || code == T_RightBrace)) {
+            span.end = i + 1;
+            decls.push_back(span);
+            span.begin = i + 1;
+            span.name.clear();
+            named = false;
+        }
+    }
+}
+
+/* Collects every declaration reachable from decl i through the names
+ * the declarations use, i included. */
+static void Reach(const vector<DeclSpan> &decls, int i, set<int> &reached) {
+    if (!reached.insert(i).second)
+        return;
+    for (size_t k = 0; k < decls[i].uses.size(); k++)
+        Reach(decls, decls[i].uses[k], reached);
+}
+
+static void DeclKeys(const string &options, const vector<ScannedToken> &tokens,
+                     vector<string> &keys) {
+    vector<DeclSpan> decls;
+    SplitDecls(tokens, decls);
+
+    // a name may be declared more than once (a prototype and its body)
+    map<string, vector<int> > declared;
+    for (size_t i = 0; i < decls.size(); i++)
+        declared[decls[i].name].push_back(i);
+    for (size_t i = 0; i < decls.size(); i++) {
+        set<int> uses;
+        for (size_t t = decls[i].begin; t < decls[i].end; t++) {
+            if (tokens[t].code != T_Identifier)
+                continue;
+            map<string, vector<int> >::iterator d = declared.find(tokens[t].text);
+            if (d != declared.end())
+                uses.insert(d->second.begin(), d->second.end());
+        }
+        uses.erase(i);
+        decls[i].uses.assign(uses.begin(), uses.end());
+    }
+
+    for (size_t i = 0; i < decls.size(); i++) {
+        set<int> reached;
+        Reach(decls, i, reached);
+        llvm::MD5 hash;
+        hash.update(options);
+        hash.update("function");
+        HashTokens(hash, tokens, decls[i].begin, decls[i].end);
+        for (set<int>::iterator r = reached.begin(); r != reached.end(); ++r)
+            if (*r != (int)i)
+                HashTokens(hash, tokens, decls[*r].begin, decls[*r].end);
+        keys.push_back(Finish(hash));
+    }
+}
+
+string CompileCache::KeyFor(SourceBuffer *input, vector<string> *declKeys) {
+    Timing::Phase phase("cache");
+    // messages from this extra scan are dropped; the compile that follows
+    // a miss reports them
+    ostringstream discard;
+    ostream *previous = &ReportError::Output();
+    ReportError::SetOutput(&discard);
+    vector<ScannedToken> tokens;
+    bool ok = ScanTokens(input, tokens);
+    ReportError::SetOutput(previous);
+    if (!ok)
+        return "";
+
+    static const string identity = CompilerIdentity();
+    ostringstream options;
+    options << identity << " -O" << GetOptimizationLevel() << '\0';
+    llvm::MD5 hash;
+    hash.update(options.str());
+    HashTokens(hash, tokens, 0, tokens.size());
+    if (declKeys != NULL)
+        DeclKeys(options.str(), tokens, *declKeys);
+    return Finish(hash);
+}
+
+string CompileCache::PathFor(const string &key) const {
+    return dir + "/" + key + ".bc";
+}
+
+bool CompileCache::Lookup(const string &key, string &bitcode) {
+    string path = PathFor(key);
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL)
+        return false;
+
+    bitcode.clear();
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        bitcode.append(buf, n);
+    bool ok = !ferror(fp) && !bitcode.empty();
+    fclose(fp);
+    if (ok)
+        utime(path.c_str(), NULL);  // most recently used
+    if (IsDebugOn("cache"))
+        fprintf(stderr, "cache: %s %s\n", ok ? "hit" : "unreadable", key.c_str());
+    return ok;
+}
+
+void CompileCache::Store(const string &key, const string &bitcode) {
+    ostringstream tmp;
+    tmp << dir << "/" << key << ".tmp." << getpid() << "." << std::this_thread::get_id();
+    string tmpPath = tmp.str();
+
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == NULL)
+        return;  // a cache we cannot write to just never hits
+    bool ok = fwrite(bitcode.data(), 1, bitcode.size(), fp) == bitcode.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), PathFor(key).c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return;
+    }
+    if (IsDebugOn("cache"))
+        fprintf(stderr, "cache: stored %s (%lu bytes)\n", key.c_str(), (unsigned long)bitcode.size());
+
+    bool evict;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        evict = ++storesSinceEvict >= StoresPerEviction;
+        if (evict) storesSinceEvict = 0;
+    }
+    if (evict)
+        Evict();
+}
+
+void CompileCache::Remove(const string &key) {
+    unlink(PathFor(key).c_str());
+    if (IsDebugOn("cache"))
+        fprintf(stderr, "cache: removed %s\n", key.c_str());
+}
+
+struct CacheEntry {
+    string path;
+    unsigned long long size;
+    time_t used;
+    bool operator<(const CacheEntry &other) const { return used < other.used; }
+};
+
+/* Removes least recently used entries until the cache is back under 90%
+ * of its bound, leaving room before the next eviction is needed. Another
+ * process may be evicting at the same time; losing an unlink race is
+ * harmless. */
+void CompileCache::Evict() {
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL)
+        return;
+
+    vector<CacheEntry> entries;
+    unsigned long long total = 0;
+    while (struct dirent *e = readdir(d)) {
+        size_t len = strlen(e->d_name);
+        if (len < 3 || strcmp(e->d_name + len - 3, ".bc") != 0)
+            continue;
+        CacheEntry entry;
+        entry.path = dir + "/" + e->d_name;
+        struct stat st;
+        if (stat(entry.path.c_str(), &st) != 0)
+            continue;
+        entry.size = st.st_size;
+        entry.used = st.st_mtime;
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    closedir(d);
+
+    if (total <= maxBytes)
+        return;
+    sort(entries.begin(), entries.end());
+    unsigned long long target = maxBytes / 10 * 9;
+    for (size_t i = 0; i < entries.size() && total > target; i++) {
+        if (unlink(entries[i].path.c_str()) == 0 || errno == ENOENT)
+            total -= entries[i].size;
+    }
+    if (IsDebugOn("cache"))
+        fprintf(stderr, "cache: evicted down to %llu bytes\n", total);
+}
@@ -0,0 +1,62 @@
+/**
+ * File: cache.h
+ * -------------
+ * An on-disk cache of compiled bitcode shared by every glc process that
+ * is pointed at the same directory (--cache-dir, or GLC_CACHE_DIR).
+ *
+ * Entries are content addressed: the key is an MD5 over the compiler's
+ * identity, the optimization level and the program's normalized token
+ * stream, so whitespace and comment edits still hit while any change
+ * that could alter the output misses. Each entry is one <key>.bc file.
+ * It is written to a temporary name and renamed into place, so readers
+ * in other processes see a whole entry or none. Reading an entry touches
+ * its mtime; when the directory grows past its size bound the least
+ * recently used entries are removed. Only programs that compiled without
+ * errors are stored.
+ *
+ * The same directory also holds single functions, for recompiling a
+ * program that changed in only a few places. A function's key covers its
+ * own tokens and those of every top-level declaration it reaches through
+ * the names it uses, transitively: the globals it reads and writes, the
+ * functions it calls, and theirs. A function whose key is unchanged is
+ * spliced into the new module from the cache instead of being emitted
+ * again (see Program::EmitFunctionsSeparately).
+ */
+
+#ifndef _H_cache
+#define _H_cache
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+class SourceBuffer;
+
+class CompileCache {
+  public:
+    CompileCache(const char *dir, unsigned long long maxBytes);
+
+    // The key for compiling the program in input with the current options,
+    // or "" if it should not be cached (it has lexical errors). If
+    // declKeys is given it receives a key for each top-level declaration,
+    // in source order.
+    static std::string KeyFor(SourceBuffer *input, std::vector<std::string> *declKeys = NULL);
+
+    bool Lookup(const std::string &key, std::string &bitcode);
+    void Store(const std::string &key, const std::string &bitcode);
+
+    // Drops an entry that turned out to be unusable, so later compiles
+    // miss on it instead of tripping over it again.
+    void Remove(const std::string &key);
+
+  private:
+    std::string PathFor(const std::string &key) const;
+    void Evict();
+
+    std::string dir;
+    unsigned long long maxBytes;
+    std::mutex lock;      // guards storesSinceEvict for glc -j
+    int storesSinceEvict;
+};
+
+#endif
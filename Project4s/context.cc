@@ -0,0 +1,86 @@
+/* File: context.cc
+ * ----------------
+ * Implementation of the per-compilation context.
+ */
+
+#include "context.h"
+#include "parser.h"
+#include "errors.h"
+#include "symtable.h"
+#include "irgen.h"
+#include "utility.h"
+#include "timing.h"
+
+thread_local CompilationContext *CompilationContext::current = NULL;
+
+CompilationContext::CompilationContext() :
+    symTable(new SymbolTable()),
+    irgen(new IRGenerator()),
+    numErrors(0),
+    cache(NULL),
+    numJobs(GetNumJobs())
+{
+}
+
+CompilationContext::~CompilationContext() {
+    delete symTable;
+    delete irgen;
+}
+
+llvm::Module *CompilationContext::GetModule() {
+    return irgen->GetOrCreateModule("mod.bc");
+}
+
+void CompilationContext::SetFunctionCache(CompileCache *c, const std::vector<std::string> &keys) {
+    cache = c;
+    declKeys = keys;
+}
+
+void CompilationContext::WriteBitcode(std::string &out) {
+    Timing::Phase phase("write");
+    GetModule();
+    irgen->WriteBitcode(out);
+}
+
+void CompilationContext::MakeCurrent() {
+    current = this;
+    Node::symTable = symTable;
+    Node::irgen = irgen;
+    Node::breakBB = &breakBB;
+    Node::continueBB = &continueBB;
+    Arena::SetCurrent(&arena);
+    ReportError::ResetNumErrors();
+}
+
+void CompilationContext::Restore(CompilationContext *previous) {
+    current = previous;
+    Node::symTable = previous ? previous->symTable : NULL;
+    Node::irgen = previous ? previous->irgen : NULL;
+    Node::breakBB = previous ? &previous->breakBB : NULL;
+    Node::continueBB = previous ? &previous->continueBB : NULL;
+    Arena::SetCurrent(previous ? &previous->arena : NULL);
+}
+
+bool CompilationContext::Compile(SourceBuffer *input) {
+    CompilationContext *previous = current;
+    MakeCurrent();
+
+    {
+        // checking and emitting run inside yyparse, and are timed apart
+        Timing::Phase phase("parse");
+        yyscan_t scanner = CreateScanner(input, &scanState);
+        yyparse(scanner);
+        DestroyScanner(scanner);
+    }
+
+    // the module is complete, so the tree it was emitted from can go
+    Arena::SetCurrent(NULL);
+    if (IsDebugOn("arena"))
+        fprintf(stderr, "arena: parse tree used %lu bytes\n",
+                (unsigned long)arena.BytesAllocated());
+    arena.Release();
+
+    numErrors = ReportError::NumErrors();
+    Restore(previous);
+    return numErrors == 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * File: context.h
+ * ---------------
+ * A CompilationContext holds everything one compilation needs that used
+ * to live in process globals: the scanner and the source it reads (which
+ * error messages quote), the parse tree arena, the symbol table, the IR
+ * generator (and with it the LLVMContext and module), the break/continue
+ * target stacks and the error count.
+ *
+ * Compile() makes the context current on the calling thread for the
+ * length of the parse. The Node statics (symTable, irgen, breakBB,
+ * continueBB), Arena::Current() and the other per-compile counters are
+ * thread-local and are pointed at this context's objects, so the tree
+ * walks reach the right state without it being passed to every Check()
+ * and Emit(). Each thread compiling with its own context is therefore
+ * independent of the others.
+ */
+
+#ifndef _H_context
+#define _H_context
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "scanner.h"
+
+class SymbolTable;
+class IRGenerator;
+class CompileCache;
+namespace llvm { class BasicBlock; class Module; }
+
+class CompilationContext {
+  public:
+    CompilationContext();
+    ~CompilationContext();
+
+    // Parses, checks and emits the program in input, which must outlive
+    // the context. Returns true if it compiled without errors. A context
+    // compiles one program.
+    bool Compile(SourceBuffer *input);
+
+    // The emitted module; owned by the context.
+    llvm::Module *GetModule();
+    void WriteBitcode(std::string &out);
+    int NumErrors() const { return numErrors; }
+
+    ScannerState *GetScannerState() { return &scanState; }
+
+    // Lets Program::Emit reuse functions compiled before: declKeys has
+    // the cache key of each top-level declaration, in source order.
+    void SetFunctionCache(CompileCache *cache, const std::vector<std::string> &declKeys);
+    CompileCache *GetFunctionCache() const { return cache; }
+    const std::vector<std::string> &GetDeclKeys() const { return declKeys; }
+
+    // Threads this compile may use to emit functions in parallel; -j by
+    // default, 1 for a unit of a batch that is already spread over -j
+    // workers, so pools are never nested.
+    void SetNumJobs(int jobs) { numJobs = jobs; }
+    int GetNumJobs() const { return numJobs; }
+
+    // The context compiling on this thread, or NULL between compiles.
+    static CompilationContext *Current() { return current; }
+
+  private:
+    void MakeCurrent();
+    void Restore(CompilationContext *previous);
+
+    ScannerState scanState;
+    Arena arena;
+    SymbolTable *symTable;
+    IRGenerator *irgen;
+    std::vector<llvm::BasicBlock*> breakBB;
+    std::vector<llvm::BasicBlock*> continueBB;
+    int numErrors;
+    CompileCache *cache;
+    std::vector<std::string> declKeys;
+    int numJobs;
+
+    static thread_local CompilationContext *current;
+};
+
+#endif
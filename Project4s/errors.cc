@@ -12,19 +12,21 @@
 using namespace std;
 
 #include "scanner.h" // for GetLineNumbered
+#include "context.h" // for the current scanner state
 #include "ast_type.h"
 #include "ast_expr.h"
 #include "ast_stmt.h"
 #include "ast_decl.h"
 
-int ReportError::numErrors = 0;
+thread_local int ReportError::numErrors = 0;
+thread_local ostream *ReportError::out = NULL;
 
 void ReportError::UnderlineErrorInLine(const char *line, yyltype *pos) {
     if (!line) return;
-    cerr << line << endl;
+    Output() << line << endl;
     for (int i = 1; i <= pos->last_column; i++)
-        cerr << (i >= pos->first_column ? '^' : ' ');
-    cerr << endl;
+        Output() << (i >= pos->first_column ? '^' : ' ');
+    Output() << endl;
 }
 
  
@@ -33,11 +35,11 @@ void ReportError::OutputError(yyltype *loc, string msg) {
     numErrors++;
     fflush(stdout); // make sure any buffered text has been output
     if (loc) {
-        cerr << endl << "*** Error line " << loc->first_line << "." << endl;
+        Output() << endl << "*** Error line " << loc->first_line << "." << endl;
         UnderlineErrorInLine(GetLineNumbered(loc->first_line), loc);
     } else
-        cerr << endl << "*** Error." << endl;
-    cerr << "*** " << msg << endl << endl;
+        Output() << endl << "*** Error." << endl;
+    Output() << "*** " << msg << endl << endl;
 }
 
 
@@ -203,6 +205,13 @@ void ReportError::ContinueOutsideLoop(ContinueStmt *cStmt) {
  * message.
  */
 
+void yyerror(yyltype *loc, yyscan_t scanner, const char *msg) {
+    ReportError::Formatted(loc, "%s", msg);
+}
+
+/* Same as above for callers outside the parser; uses the location of the
+ * last token read by the scanner of the compilation on this thread. */
 void yyerror(const char *msg) {
-    ReportError::Formatted(&yylloc, "%s", msg);
+    CompilationContext *ctx = CompilationContext::Current();
+    ReportError::Formatted(ctx ? &ctx->GetScannerState()->lastLoc : NULL, "%s", msg);
 }
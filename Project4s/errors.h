@@ -14,6 +14,7 @@
 #define _errors_h_
 
 #include <string>
+#include <iostream>
 #include "location.h"
 #include "ast_decl.h"
 
@@ -30,7 +31,7 @@ using namespace std;
  * the class name, e.g.
  *
  *    if (missingEnd) { 
- *       ReportError::UntermString(&yylloc, str);
+ *       ReportError::UntermString(yylloc, str);
  *    }
  *
  * For some methods, the first argument is the pointer to the location
@@ -105,10 +106,19 @@ class ReportError {
 
   // Returns number of error messages printed
   static int NumErrors() { return numErrors; }
+
+  // Starts the count over for the next compilation unit in batch mode
+  static void ResetNumErrors() { numErrors = 0; }
+
+  // Messages go to cerr unless the calling thread redirects them; glc -j
+  // collects each unit's messages so they can be printed in input order.
+  static void SetOutput(ostream *os) { out = os; }
+  static ostream &Output() { return out ? *out : cerr; }
   
  private:
   static void UnderlineErrorInLine(const char *line, yyltype *pos);
   static void OutputError(yyltype *loc, string msg);
-  static int numErrors;
+  static thread_local int numErrors;
+  static thread_local ostream *out;
 };
 #endif
@@ -0,0 +1,99 @@
+/* File: intern.cc
+ * ---------------
+ * Implementation of the interned name table: an open-addressing hash
+ * table of Symbols over names packed into large character blocks.
+ */
+
+#include "intern.h"
+#include "utility.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+using std::vector;
+
+const Symbol Interner::NoSymbol;
+
+static const int TextBlockSize = 16 * 1024;
+static const int InitialBuckets = 256;     // must be a power of two
+
+static vector<const char*> names;          // indexed by Symbol
+static vector<unsigned> hashes;            // hash of each name, by Symbol
+static vector<Symbol> buckets;             // NoSymbol marks an empty bucket
+static char *textNext = NULL, *textLimit = NULL;
+static std::mutex lock;                    // the table is shared by all threads
+
+static unsigned HashName(const char *str, int len) {
+    unsigned h = 2166136261u;               // FNV-1a
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static const char *SaveText(const char *str, int len) {
+    if (textNext == NULL || textLimit - textNext < len + 1) {
+        int size = len + 1 > TextBlockSize ? len + 1 : TextBlockSize;
+        textNext = (char *)malloc(size);
+        if (textNext == NULL)
+            Failure("Out of memory interning \"%.*s\"", len, str);
+        textLimit = textNext + size;
+    }
+    char *copy = textNext;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    textNext += len + 1;
+    return copy;
+}
+
+static void Rehash(int numBuckets) {
+    buckets.assign(numBuckets, Interner::NoSymbol);
+    for (Symbol s = 0; s < (Symbol)names.size(); s++) {
+        unsigned i = hashes[s] & (numBuckets - 1);
+        while (buckets[i] != Interner::NoSymbol)
+            i = (i + 1) & (numBuckets - 1);
+        buckets[i] = s;
+    }
+}
+
+Symbol Interner::Intern(const char *str, int len) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (buckets.empty())
+        Rehash(InitialBuckets);
+
+    unsigned h = HashName(str, len);
+    unsigned mask = buckets.size() - 1;
+    unsigned i = h & mask;
+    while (buckets[i] != NoSymbol) {
+        Symbol s = buckets[i];
+        if (hashes[s] == h && strncmp(names[s], str, len) == 0 && names[s][len] == '\0')
+            return s;
+        i = (i + 1) & mask;
+    }
+
+    Symbol s = names.size();
+    names.push_back(SaveText(str, len));
+    hashes.push_back(h);
+    buckets[i] = s;
+
+    // keep the load factor under one half
+    if (names.size() * 2 > buckets.size())
+        Rehash(buckets.size() * 2);
+    return s;
+}
+
+Symbol Interner::Intern(const char *str) {
+    return Intern(str, strlen(str));
+}
+
+const char *Interner::NameOf(Symbol sym) {
+    std::lock_guard<std::mutex> guard(lock);
+    Assert(sym >= 0 && sym < (Symbol)names.size());
+    return names[sym];
+}
+
+int Interner::NumSymbols() {
+    std::lock_guard<std::mutex> guard(lock);
+    return names.size();
+}
@@ -0,0 +1,37 @@
+/**
+ * File: intern.h
+ * --------------
+ * A process-wide table of interned names. The scanner interns every
+ * identifier and field selection it reads, and from then on the name is
+ * carried around as a Symbol: a small integer that is equal for two
+ * names exactly when their text is equal. Identifier nodes and the
+ * symbol table keep Symbols, so name comparisons are integer compares
+ * and each distinct spelling is stored once no matter how often it
+ * appears in the source.
+ *
+ * Symbols are dense (0, 1, 2, ...) in order of first appearance, which
+ * lets tables indexed by Symbol be plain arrays. Interned text is never
+ * freed, so pointers returned by NameOf() stay valid for the life of the
+ * process. The table is locked internally and may be used from several
+ * compiling threads at once.
+ */
+
+#ifndef _H_intern
+#define _H_intern
+
+typedef int Symbol;
+
+class Interner {
+  public:
+    static const Symbol NoSymbol = -1;
+
+    // Returns the symbol for the first len characters of str, adding it
+    // to the table if this is the first time the spelling has been seen.
+    static Symbol Intern(const char *str, int len);
+    static Symbol Intern(const char *str);
+
+    static const char *NameOf(Symbol sym);
+    static int NumSymbols();
+};
+
+#endif
@@ -4,6 +4,15 @@
  */
 
 #include "irgen.h"
+#include "timing.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Vectorize.h"
 
 IRGenerator::IRGenerator() :
     context(NULL),
@@ -14,6 +23,8 @@ IRGenerator::IRGenerator() :
 }
 
 IRGenerator::~IRGenerator() {
+   delete module;
+   delete context;
 }
 
 llvm::Module *IRGenerator::GetOrCreateModule(const char *moduleID)
@@ -43,6 +54,96 @@ llvm::BasicBlock *IRGenerator::GetBasicBlock() const {
    return currentBB;
 }
 
+void IRGenerator::ResetGlobalSlots(int count) {
+   globalSlots.assign(count, (llvm::Value*)NULL);
+}
+
+void IRGenerator::ResetLocalSlots(int count) {
+   localSlots.assign(count, (llvm::Value*)NULL);
+}
+
+void IRGenerator::SetSlot(bool global, int slot, llvm::Value *storage) {
+   (global ? globalSlots : localSlots).at(slot) = storage;
+}
+
+llvm::Value *IRGenerator::GetSlot(bool global, int slot) const {
+   return (global ? globalSlots : localSlots).at(slot);
+}
+
+llvm::AllocaInst *IRGenerator::CreateEntryAlloca(llvm::Type *type, const llvm::Twine &name) {
+   llvm::BasicBlock &entry = currentFunc->getEntryBlock();
+   llvm::BasicBlock::iterator it = entry.begin();
+   while (it != entry.end() && llvm::isa<llvm::AllocaInst>(*it))
+      ++it;
+   if (it == entry.end())
+      return new llvm::AllocaInst(type, name, &entry);
+   return new llvm::AllocaInst(type, name, &*it);
+}
+
+/* Method: Optimize
+ * ----------------
+ * -O1 promotes every local alloca to SSA registers and cleans up the
+ * result. -O2 adds the inliner, GVN, loop invariant code motion and loop
+ * unrolling. -O3 also runs the loop and SLP vectorizers and unrolls more
+ * aggressively. Entry points and globals keep external linkage, so
+ * nothing the interpreter looks up is removed.
+ */
+void IRGenerator::Optimize(int level) {
+   if (level <= 0 || module == NULL)
+      return;
+
+   Timing::Phase phase("optimize");
+   llvm::legacy::PassManager pm;
+
+   if (level >= 2)
+      pm.add(llvm::createFunctionInliningPass(level, 0));
+
+   pm.add(llvm::createPromoteMemoryToRegisterPass());
+   pm.add(llvm::createInstructionCombiningPass());
+   pm.add(llvm::createCFGSimplificationPass());
+
+   if (level >= 2) {
+      pm.add(llvm::createReassociatePass());
+      pm.add(llvm::createGVNPass());
+      pm.add(llvm::createLoopRotatePass());
+      pm.add(llvm::createLICMPass());
+      pm.add(llvm::createIndVarSimplifyPass());
+      pm.add(llvm::createLoopUnrollPass(level >= 3 ? 300 : -1));
+      pm.add(llvm::createInstructionCombiningPass());
+      pm.add(llvm::createCFGSimplificationPass());
+   }
+
+   if (level >= 3) {
+      pm.add(llvm::createLoopVectorizePass());
+      pm.add(llvm::createSLPVectorizerPass());
+      pm.add(llvm::createInstructionCombiningPass());
+      pm.add(llvm::createCFGSimplificationPass());
+   }
+
+   if (level >= 2)
+      pm.add(llvm::createGlobalDCEPass());
+
+   pm.run(*module);
+}
+
+unsigned IRGenerator::NumBasicBlocks() const {
+   unsigned count = 0;
+   if (module != NULL)
+      for (llvm::Module::iterator f = module->begin(); f != module->end(); ++f)
+         count += f->size();
+   return count;
+}
+
+unsigned IRGenerator::NumInstructions() const {
+   unsigned count = 0;
+   if (module == NULL)
+      return count;
+   for (llvm::Module::iterator f = module->begin(); f != module->end(); ++f)
+      for (llvm::Function::iterator bb = f->begin(); bb != f->end(); ++bb)
+         count += bb->size();
+   return count;
+}
+
 llvm::Type *IRGenerator::GetIntType() const {
    llvm::Type *ty = llvm::Type::getInt32Ty(*context);
    return ty;
@@ -73,48 +174,50 @@ llvm::Type *IRGenerator::convertType(Type *ty, llvm::LLVMContext *context) {
       t = llvm::Type::getFloatTy(*context);
    }
 
-   //More types TODO here - Vec2/3/4, Mat2/3/4
-
-   return t;
-
-}
+   else if (ty == Type::uintType) {
+      t = llvm::Type::getInt32Ty(*context);
+   }
 
+   else if (ty->IsVector()) {
+      llvm::Type *lane = convertType(ty->ComponentType(), context);
+      t = llvm::VectorType::get(lane, PaddedLanes(ty->NumComponents()));
+   }
 
+   else if (ty->IsMatrix()) {
+      llvm::Type *column = convertType(ty->ComponentType(), context);
+      t = llvm::ArrayType::get(column, ty->NumComponents());
+   }
 
-/*llvm::Type *IRGenerator::GetVec2Type() const {
-   llvm::Type *ty = llvm::VectorType::get(llvm::Type::getFloatTy(*context), 2);
-   return ty;
-}
+   return t;
 
-llvm::Type *IRGenerator::GetVec3Type() const {
-   llvm::Type *ty = llvm::VectorType::get(llvm::Type::getFloatTy(*context), 3);
-   return ty;
 }
 
-llvm::Type *IRGenerator::GetVec4Type() const {
-   llvm::Type *ty = llvm::VectorType::get(llvm::Type::getFloatTy(*context), 4);
-   return ty;
+void IRGenerator::WriteBitcode(std::string &out) const {
+   llvm::raw_string_ostream os(out);
+   llvm::WriteBitcodeToFile(module, os);
+   os.flush();
 }
 
-llvm::Type *IRGenerator::GetMat2Type() const {
-   llvm::Type *elementTy = llvm::VectorType::get(llvm::Type::getFloatTy(*context), 2);
-   llvm::Type *ty = llvm::ArrayType::get(elementTy, 2);
-   return ty;
+bool IRGenerator::LinkBitcode(const std::string &bitcode) {
+   Timing::Phase phase("link");
+   llvm::ErrorOr<std::unique_ptr<llvm::Module>> part =
+       llvm::parseBitcodeFile(llvm::MemoryBufferRef(bitcode, "function"), *context);
+   if (!part)
+      return false;
+   // linkModules returns true on error
+   return !llvm::Linker::linkModules(*GetOrCreateModule("mod.bc"), std::move(part.get()));
 }
 
-llvm::Type *IRGenerator::GetMat3Type() const {
-   llvm::Type *elementTy = llvm::VectorType::get(llvm::Type::getFloatTy(*context), 2);
-   llvm::Type *ty = llvm::ArrayType::get(elementTy, 3);
-   return ty;
-
+void IRGenerator::RemoveUnusedDeclarations() {
+   llvm::Module::global_iterator gi = module->global_begin();
+   while (gi != module->global_end()) {
+      llvm::GlobalVariable *gv = &*gi++;
+      if (gv->isDeclaration() && gv->use_empty())
+         gv->eraseFromParent();
+   }
 }
 
-llvm::Type *IRGenerator::GetMat4Type() const {
-   llvm::Type *elementTy = llvm::VectorType::get(llvm::Type::getFloatTy(*context), 2);
-   llvm::Type *ty = llvm::ArrayType::get(elementTy, 4);
-   return ty;
-
-}*/
+const char *IRGenerator::ResultLanesAttr = "glc-result-lanes";
 
 const char *IRGenerator::TargetLayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128";
 
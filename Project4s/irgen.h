@@ -11,6 +11,9 @@
 #ifndef _H_IRGen
 #define _H_IRGen
 
+#include <vector>
+#include <string>
+
 // LLVM headers
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LLVMContext.h"
@@ -38,12 +41,48 @@ class IRGenerator {
     llvm::Type *GetFloatType() const;
     static llvm::Type *convertType(Type *ty, llvm::LLVMContext *context);
 
-/*  llvm::Type *GetVec2Type() const;
-    llvm::Type *GetVec3Type() const;
-    llvm::Type *GetVec4Type() const;
-    llvm::Type *GetMat2Type() const;
-    llvm::Type *GetMat3Type() const;
-    llvm::Type *GetMat4Type() const; */
+    // Vectors are lowered to LLVM vectors of their component type, with
+    // 3-component vectors padded to 4 lanes so that each one is a single
+    // aligned 16-byte register, load and store. The pad lane is undefined
+    // and never read back. A matN is an array of N column vecNs, padded
+    // the same way, so a mat3 is three 16-byte columns.
+    static int PaddedLanes(int n) { return n == 3 ? 4 : n; }
+
+    // String attribute on a function returning a padded vector (or matrix
+    // of padded columns) that holds how many lanes are real, for the --run
+    // result printer.
+    static const char *ResultLanesAttr;
+
+    // Storage for variables, indexed by the slot Check() gave each
+    // VarDecl: one table for the module's globals and one for the locals
+    // of the function being emitted.
+    void ResetGlobalSlots(int count);
+    void ResetLocalSlots(int count);
+    void SetSlot(bool global, int slot, llvm::Value *storage);
+    llvm::Value *GetSlot(bool global, int slot) const;
+
+    // Allocates a local's stack slot at the top of the current function's
+    // entry block, after the slots already there. A variable declared in
+    // a loop body then takes its stack space once per call rather than
+    // once per iteration, and mem2reg can promote it.
+    llvm::AllocaInst *CreateEntryAlloca(llvm::Type *type, const llvm::Twine &name);
+
+    // Runs the pass pipeline for optimization level 0-3 over the module.
+    // Level 0 leaves the IR exactly as it was emitted.
+    void Optimize(int level);
+    unsigned NumInstructions() const;
+    unsigned NumBasicBlocks() const;
+
+    // For emitting functions on several threads: each worker's module is
+    // handed back as bitcode and linked into this generator's module,
+    // since modules in different LLVMContexts cannot be linked directly.
+    // LinkBitcode returns false if the bitcode cannot be read or linked.
+    void WriteBitcode(std::string &out) const;
+    bool LinkBitcode(const std::string &bitcode);
+
+    // Erases global declarations nothing in the module refers to.
+    void RemoveUnusedDeclarations();
+
   private:
     llvm::LLVMContext *context;
     llvm::Module      *module;
@@ -52,6 +91,9 @@ class IRGenerator {
     llvm::Function    *currentFunc;
     llvm::BasicBlock  *currentBB;
 
+    std::vector<llvm::Value*> globalSlots;
+    std::vector<llvm::Value*> localSlots;
+
     static const char *TargetTriple;
     static const char *TargetLayout;
 };
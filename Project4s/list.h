@@ -30,6 +30,7 @@
 
 #include <deque>
 #include "utility.h"  // for Assert()
+#include "arena.h"
 using namespace std;
 
 class Node;
@@ -43,6 +44,17 @@ template<class Element> class List {
            // Create a new empty list
     List() {}
 
+          // Lists built while an Arena is current live in the arena with
+          // the parse tree; the arena destroys them (and so frees the
+          // deque's own storage) when it is released.
+    static void *operator new(size_t size)
+	{ if (Arena *arena = Arena::Current())
+	      return arena->Allocate(size, &Destroy);
+	  return ::operator new(size); }
+    static void operator delete(void *p)
+	{ Arena *arena = Arena::Current();
+	  if (arena == NULL || !arena->Contains(p)) ::operator delete(p); }
+
            // Returns count of elements currently in list
     int NumElements() const
 	{ return elems.size(); }
@@ -53,6 +65,12 @@ template<class Element> class List {
 	{ Assert(index >= 0 && index < NumElements());
 	  return elems[index]; }
 
+          // Replaces the element at index
+          // Raises an assert if index is out of range
+    void SetNth(int index, const Element &elem)
+	{ Assert(index >= 0 && index < NumElements());
+	  elems[index] = elem; }
+
           // Inserts element at index, shuffling over others
           // Raises assert if index out of range
     void InsertAt(const Element &elem, int index)
@@ -80,7 +98,10 @@ template<class Element> class List {
     void PrintAll(int indentLevel, const char *label = NULL)
         { for (int i = 0; i < NumElements(); i++)
              Nth(i)->Print(indentLevel, label); }
-             
+
+ private:
+    static void Destroy(void *p)
+        { static_cast<List *>(p)->~List(); }
 
 };
 
@@ -6,25 +6,190 @@
  
 #include <string.h>
 #include <stdio.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "context.h"
+#include "runner.h"
+#include "threadpool.h"
+#include "cache.h"
+#include "timing.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 
+// The compile cache, when one was asked for
+static CompileCache *cache = NULL;
+
+/* Function: OutputPathFor()
+ * -------------------------
+ * foo.glsl is written to foo.bc next to it; other names get .bc appended.
+ */
+static std::string OutputPathFor(const char *input)
+{
+    std::string path(input);
+    size_t dot = path.rfind(".glsl");
+    if (dot != std::string::npos && dot + 5 == path.size())
+        path.erase(dot);
+    return path + ".bc";
+}
+
+/* Function: CompileToBitcode()
+ * ----------------------------
+ * Compiles the program in source into bitcode. With a compile cache
+ * the program is looked up first, and a program that misses is stored
+ * once it has compiled cleanly. Returns true on success.
+ */
+static bool CompileToBitcode(SourceBuffer *source, std::string &bitcode, int jobs)
+{
+    std::string key;
+    std::vector<std::string> declKeys;
+    if (cache != NULL) {
+        key = CompileCache::KeyFor(source, &declKeys);
+        if (!key.empty() && cache->Lookup(key, bitcode))
+            return true;
+    }
+
+    // on a miss, functions that did not change still come from the cache
+    CompilationContext ctx;
+    ctx.SetNumJobs(jobs);
+    if (!key.empty())
+        ctx.SetFunctionCache(cache, declKeys);
+    if (!ctx.Compile(source))
+        return false;
+    ctx.WriteBitcode(bitcode);
+    if (!key.empty())
+        cache->Store(key, bitcode);
+    return true;
+}
+
+/* Function: CompileFile()
+ * -----------------------
+ * Compiles one input file of a batch to its own .bc file. Each file gets
+ * a fresh CompilationContext, so it is compiled exactly as if it had been
+ * the only one. It may use jobs threads of its own. Returns true on
+ * success.
+ */
+static bool CompileFile(const char *input, int jobs)
+{
+    SourceBuffer source;
+    if (!source.Map(input)) {
+        ReportError::Formatted(NULL, "Cannot open input file %s.", input);
+        return false;
+    }
+
+    std::string bitcode;
+    if (!CompileToBitcode(&source, bitcode, jobs)) {
+        ReportError::Output() << input << ": compilation failed" << endl;
+        return false;
+    }
+
+    std::string output = OutputPathFor(input);
+    std::error_code ec;
+    llvm::raw_fd_ostream out(output, ec, llvm::sys::fs::F_None);
+    if (ec) {
+        ReportError::Formatted(NULL, "Cannot write %s: %s", output.c_str(), ec.message().c_str());
+        return false;
+    }
+    out << bitcode;
+    return true;
+}
+
+/* Function: CompileBatch()
+ * ------------------------
+ * Compiles every input file on a pool of -j worker threads, each unit in
+ * a CompilationContext of its own. A unit's diagnostics are collected on
+ * the side and printed once the batch is done, in input order, so neither
+ * the .bc files nor the messages depend on how the work was scheduled.
+ * The pool is the batch's only one: each unit compiles on one thread.
+ * Returns the number of units that failed.
+ */
+static int CompileBatch()
+{
+    int n = NumInputFiles();
+    std::vector<std::string> messages(n);
+    std::vector<char> ok(n, false);   // not vector<bool>: written concurrently
+
+    WorkStealingPool pool(std::min(GetNumJobs(), n));
+    pool.Run(n, [&](int i) {
+        std::ostringstream diag;
+        ReportError::SetOutput(&diag);
+        ok[i] = CompileFile(GetInputFile(i), 1);
+        ReportError::SetOutput(NULL);
+        messages[i] = diag.str();
+    });
+
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        cerr << messages[i];
+        if (!ok[i]) failed++;
+    }
+    return failed;
+}
+
+/* Function: CompileInputs()
+ * -------------------------
+ * With no input files a single program is read from stdin and its
+ * bitcode written to stdout, or with --run executed instead. Input files
+ * on the command line (or in a --manifest) are compiled in this process,
+ * each to its own .bc file, one after another or with -j N on N threads;
+ * a unit that fails does not stop the rest of the batch. With a cache
+ * directory, programs compiled before are served from the cache.
+ * Returns the exit status.
+ */
+static int CompileInputs()
+{
+    if (NumInputFiles() > 0) {
+        int failed = 0;
+        if (GetNumJobs() > 1)
+            failed = CompileBatch();
+        else
+            for (int i = 0; i < NumInputFiles(); i++)
+                if (!CompileFile(GetInputFile(i), GetNumJobs()))
+                    failed++;
+        return (failed == 0? 0 : -1);
+    }
+
+    SourceBuffer source;
+    if (!source.Read(stdin)) {
+        ReportError::Formatted(NULL, "Cannot read the program from stdin.");
+        return -1;
+    }
+
+    if (GetRunDataFile() != NULL) {
+        CompilationContext ctx;
+        if (!ctx.Compile(&source))
+            return -1;
+        return (RunModule(ctx.GetModule(), GetRunDataFile(), GetBenchCalls())? 0 : -1);
+    }
+
+    std::string bitcode;
+    if (!CompileToBitcode(&source, bitcode, GetNumJobs()))
+        return -1;
+    llvm::outs() << bitcode;
+    return 0;
+}
 
 /* Function: main()
  * ----------------
  * Entry point to the entire program.  We parse the command line and turn
  * on any debugging flags requested by the user when invoking the program.
- * InitScanner() is used to set up the scanner.
- * InitParser() is used to set up the parser. The call to yyparse() will
- * attempt to parse a complete program from the input. 
+ * InitParser() is used to set up the parser; each compilation makes its
+ * own scanner. The timing report, if one was asked for, covers every
+ * compile the run did.
  */
 int main(int argc, char *argv[])
 {
     ParseCommandLine(argc, argv);
-    InitScanner();
     InitParser();
-    yyparse();
-    return (ReportError::NumErrors() == 0? 0 : -1);
-}
+    Timing::Init();
+    if (GetCacheDir() != NULL)
+        cache = new CompileCache(GetCacheDir(), GetCacheSize());
 
+    int status = CompileInputs();
+    Timing::Report();
+    return status;
+}
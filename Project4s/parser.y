@@ -16,14 +16,21 @@
  * file inclusions or C++ variable declarations/prototypes that are needed
  * by your code here.
  */
-#include "scanner.h" // for yylex
+#include "scanner.h" // for yyscan_t
 #include "parser.h"
 #include "errors.h"
 
-void yyerror(const char *msg); // standard error-handling routine
-
 %}
 
+/* The parser is pure: yylval and yylloc are locals of yyparse() rather
+ * than globals, and the scanner to read from is passed in, so separate
+ * threads can each parse their own input.
+ */
+%define api.pure
+%locations
+%parse-param { yyscan_t scanner }
+%lex-param   { yyscan_t scanner }
+
 /* The section before the first %% is the Definitions section of the yacc
  * input file. Here is where you declare tokens and types, add precedence
  * and associativity options, and so on.
@@ -43,6 +50,7 @@ void yyerror(const char *msg); // standard error-handling routine
     bool boolConstant;
     double floatConstant;
     char identifier[MaxIdentLen+1]; // +1 for terminating null
+    Symbol symbol;                  // interned identifier, see intern.h
     Decl *decl;
     FnDecl *funcDecl;
     List<Decl*> *declList;
@@ -58,6 +66,11 @@ void yyerror(const char *msg); // standard error-handling routine
     List<Expr*> *argList;
 }
 
+%{
+int yylex(YYSTYPE *lvalp, yyltype *llocp, yyscan_t scanner); // Defined in lex.yy.c
+void yyerror(yyltype *loc, yyscan_t scanner, const char *msg); // Defined in errors.cc
+%}
+
 
 /* Tokens
  * ------
@@ -81,11 +94,11 @@ void yyerror(const char *msg); // standard error-handling routine
 %token   <identifier> T_MulAssign T_DivAssign T_AddAssign T_SubAssign T_Equal
 %token   <identifier> T_LeftAngle T_RightAngle T_Dash T_Slash
 %token   <identifier> T_Inc T_Dec 
-%token   <identifier> T_Identifier
+%token   <symbol> T_Identifier
 %token   <integerConstant> T_IntConstant
 %token   <floatConstant> T_FloatConstant
 %token   <boolConstant> T_BoolConstant
-%token   <identifier> T_FieldSelection
+%token   <symbol> T_FieldSelection
 
 %nonassoc LOWEST
 %nonassoc LOWER_THAN_ELSE
@@ -143,7 +156,12 @@ Program   :    DeclList            {
                                           if ( IsDebugOn("dumpAST") ) {
                                             program->Print(0);
                                           }
-                                          program->Emit();
+                                          program->Check();
+                                          if (ReportError::NumErrors() == 0) {
+                                              program->Fold();
+                                              if (ReportError::NumErrors() == 0)
+                                                  program->Emit();
+                                          }
                                       }
                                     }
           ;
@@ -178,13 +196,13 @@ Declaration : FuncDecl T_Semicolon   { $$ = $1; }
 
 FuncDecl  : TypeDecl T_Identifier T_LeftParen T_RightParen 
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             List<VarDecl *> *formals = new List<VarDecl *>;
                             $$ = new FnDecl(id, $1, formals);
                          }
           | TypeDecl T_Identifier T_LeftParen ParameterList T_RightParen 
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             $$ = new FnDecl(id, $1, $4);
                          }
           ;
@@ -195,28 +213,28 @@ ParameterList : SingleDecl { ($$ = new List<VarDecl *>)->Append($1);  }
 
 SingleDecl    : TypeDecl T_Identifier
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             $$ = new VarDecl(id, $1);
                          }
               | TypeQualify TypeDecl T_Identifier
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$3); 
+                            Identifier *id = new Identifier(yylloc, $3); 
                             $$ = new VarDecl(id, $2, $1);
                          }
               | TypeDecl T_Identifier T_Equal Initializer
                          {
                             // incomplete: drop the initializer here
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(yylloc, $2); 
                             $$ = new VarDecl(id, $1, $4);
                          }
               | TypeQualify TypeDecl T_Identifier T_Equal Initializer
                          {
-                            Identifier *id = new Identifier(yylloc, (const char *)$3); 
+                            Identifier *id = new Identifier(yylloc, $3); 
                             $$ = new VarDecl(id, $2, $1, $5);
                          }
               | TypeDecl T_Identifier T_LeftBracket T_IntConstant T_RightBracket 
                          { 
-                            Identifier *id = new Identifier(@2, (const char *)$2);
+                            Identifier *id = new Identifier(@2, $2);
                             $$ = new VarDecl(id, new ArrayType(@1, $1, $4));
                          }
               | TypeQualify TypeDecl T_Identifier T_LeftBracket T_IntConstant T_RightBracket 
@@ -240,9 +258,19 @@ TypeDecl       : T_Int                   { $$ = Type::intType;    }
                | T_Void                  { $$ = Type::voidType;   }
                | T_Float                 { $$ = Type::floatType;  }
                | T_Bool                  { $$ = Type::boolType;   }
+               | T_Uint                  { $$ = Type::uintType;   }
                | T_Vec2                  { $$ = Type::vec2Type;   }
                | T_Vec3                  { $$ = Type::vec3Type;   }
                | T_Vec4                  { $$ = Type::vec4Type;   }
+               | T_Ivec2                 { $$ = Type::ivec2Type;  }
+               | T_Ivec3                 { $$ = Type::ivec3Type;  }
+               | T_Ivec4                 { $$ = Type::ivec4Type;  }
+               | T_Uvec2                 { $$ = Type::uvec2Type;  }
+               | T_Uvec3                 { $$ = Type::uvec3Type;  }
+               | T_Uvec4                 { $$ = Type::uvec4Type;  }
+               | T_Bvec2                 { $$ = Type::bvec2Type;  }
+               | T_Bvec3                 { $$ = Type::bvec3Type;  }
+               | T_Bvec4                 { $$ = Type::bvec4Type;  }
                | T_Mat2                  { $$ = Type::mat2Type;   }
                | T_Mat3                  { $$ = Type::mat3Type;   }
                | T_Mat4                  { $$ = Type::mat4Type;   }
@@ -308,7 +336,7 @@ ForStmt            : T_For T_LeftParen Expression T_Semicolon Expression T_Semic
                                  }
                    ;
 
-PrimaryExpr        : T_Identifier    { Identifier *id = new Identifier(yylloc, (const char*)$1);
+PrimaryExpr        : T_Identifier    { Identifier *id = new Identifier(yylloc, $1);
                                        $$ = new VarExpr(yyloc, id);
                                      }
                    | T_IntConstant   { $$ = new IntConstant(yylloc, $1); }
@@ -352,7 +380,7 @@ PostfixExpr        : PrimaryExpr     { $$ = $1; }
                                        }
                    | PostfixExpr T_Dot T_FieldSelection
                                        {
-                                          Identifier *id = new Identifier(yylloc, (const char *)$3);
+                                          Identifier *id = new Identifier(yylloc, $3);
                                           $$ = new FieldAccess($1, id);
                                        }
                    ;
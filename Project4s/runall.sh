@@ -11,7 +11,5 @@ else
 	done
 fi
 
-for file in $LIST; do
-        echo $file
-	./glc < $file 
-done
+# one glc compiles the whole list, each file to its own .bc, on JOBS threads
+./glc -j ${JOBS:-`nproc`} $LIST
@@ -0,0 +1,381 @@
+/* File: runner.cc
+ * ---------------
+ * Implementation of the in-process JIT runner behind glc --run.
+ */
+
+#include "runner.h"
+#include "errors.h"
+#include "irgen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace std;
+
+// Name of the generated function that calls the entry point.
+static const char *ThunkName = "__glc_run";
+
+// Largest result we print: a mat4.
+static const int ResultBytes = 64;
+
+// --bench times this many samples of the requested number of calls, and
+// reports their mean with a 95% confidence interval from Student's t for
+// BenchSamples - 1 degrees of freedom.
+static const int BenchSamples = 10;
+static const double BenchT95 = 2.262;
+
+typedef void (*ThunkFn)(void *out);
+
+/* One "key: a, b, c" line of a .dat file. For "gin:" the first field is
+ * the global's name, the second its type and the rest its values; for
+ * "param:" the first field is the type and the rest its values. */
+struct DatLine {
+    string key;
+    vector<string> fields;
+};
+
+static string Trim(const string &s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+static bool ReadDatFile(const char *path, vector<DatLine> &lines) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return false;
+
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), fp)) {
+        string text(buf);
+        size_t colon = text.find(':');
+        if (colon == string::npos)
+            continue;
+
+        DatLine line;
+        line.key = Trim(text.substr(0, colon));
+        string rest = text.substr(colon + 1);
+        size_t start = 0, comma;
+        while ((comma = rest.find(',', start)) != string::npos) {
+            line.fields.push_back(Trim(rest.substr(start, comma - start)));
+            start = comma + 1;
+        }
+        line.fields.push_back(Trim(rest.substr(start)));
+        lines.push_back(line);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool ParseBool(const string &s) {
+    return s == "true" || (s != "false" && atoi(s.c_str()) != 0);
+}
+
+/* The number of components the .dat type name gives each vector or
+ * matrix column ("vec3" and "mat3" give 3), or 0 for a scalar. A vec3
+ * is 4 lanes in LLVM, so this, not the LLVM type, says how many values
+ * each one takes from the file. */
+static unsigned DatLanes(const string &type) {
+    char last = type.empty() ? '\0' : type[type.size() - 1];
+    return (last >= '2' && last <= '4') ? last - '0' : 0;
+}
+
+/* Builds a constant of type ty from vals[pos...], advancing pos past the
+ * values used. Vectors take one value per component, up to lanes of
+ * them, and matrices one vector per column. */
+static llvm::Constant *ParseConstant(llvm::Type *ty, const vector<string> &vals, size_t &pos,
+                                     unsigned lanes) {
+    if (llvm::ArrayType *at = llvm::dyn_cast<llvm::ArrayType>(ty)) {
+        vector<llvm::Constant*> cols;
+        for (unsigned j = 0; j < at->getNumElements(); j++) {
+            llvm::Constant *c = ParseConstant(at->getElementType(), vals, pos, lanes);
+            if (c == NULL)
+                return NULL;
+            cols.push_back(c);
+        }
+        return llvm::ConstantArray::get(at, cols);
+    }
+
+    if (llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(ty)) {
+        vector<llvm::Constant*> elems;
+        for (unsigned i = 0; i < vt->getNumElements(); i++) {
+            // pad lanes, and lanes the file gives no value for, are left undefined
+            if ((lanes != 0 && i >= lanes) || (pos >= vals.size() && !elems.empty()))
+                elems.push_back(llvm::UndefValue::get(vt->getElementType()));
+            else if (llvm::Constant *c = ParseConstant(vt->getElementType(), vals, pos, 0))
+                elems.push_back(c);
+            else
+                return NULL;
+        }
+        return llvm::ConstantVector::get(elems);
+    }
+
+    if (pos >= vals.size())
+        return NULL;
+    const string &s = vals[pos++];
+    if (ty->isIntegerTy(1))
+        return llvm::ConstantInt::get(ty, ParseBool(s));
+    if (ty->isIntegerTy())
+        return llvm::ConstantInt::get(ty, strtol(s.c_str(), NULL, 10), true);
+    if (ty->isFloatingPointTy())
+        return llvm::ConstantFP::get(ty, atof(s.c_str()));
+    return NULL;
+}
+
+/* Writes vals[pos...] into memory of type ty at addr, taking at most
+ * lanes values for each vector or matrix column. */
+static bool StoreValue(char *addr, llvm::Type *ty, const vector<string> &vals,
+                       size_t &pos, const llvm::DataLayout &layout, unsigned lanes) {
+    if (llvm::ArrayType *at = llvm::dyn_cast<llvm::ArrayType>(ty)) {
+        uint64_t stride = layout.getTypeAllocSize(at->getElementType());
+        for (unsigned j = 0; j < at->getNumElements(); j++)
+            if (!StoreValue(addr + j * stride, at->getElementType(), vals, pos, layout, lanes))
+                return false;
+        return true;
+    }
+
+    if (llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(ty)) {
+        llvm::Type *elem = vt->getElementType();
+        if (elem->isIntegerTy(1))
+            return false;  // bool vectors are bit-packed in memory
+        uint64_t stride = layout.getTypeAllocSize(elem);
+        unsigned n = (lanes != 0 && lanes < vt->getNumElements()) ? lanes : vt->getNumElements();
+        for (unsigned i = 0; i < n && pos < vals.size(); i++)
+            if (!StoreValue(addr + i * stride, elem, vals, pos, layout, 0))
+                return false;
+        return true;
+    }
+
+    if (pos >= vals.size())
+        return false;
+    const string &s = vals[pos++];
+    if (ty->isIntegerTy(1))
+        *(unsigned char *)addr = ParseBool(s);
+    else if (ty->isIntegerTy(32))
+        *(int *)addr = atoi(s.c_str());
+    else if (ty->isFloatTy())
+        *(float *)addr = atof(s.c_str());
+    else
+        return false;
+    return true;
+}
+
+/* Function: BuildThunk
+ * --------------------
+ * Adds "void __glc_run(T *out)" to the module, which calls entry with
+ * the given constant arguments and stores its result through out. Bools
+ * are widened to a byte first so they can be read back one per byte. The
+ * store is only 4-byte aligned so the caller's buffer need not be. */
+static void BuildThunk(llvm::Module *m, llvm::Function *entry, const vector<llvm::Value*> &args) {
+    llvm::LLVMContext &ctx = m->getContext();
+    llvm::Type *retTy = entry->getReturnType();
+    llvm::Type *outTy = retTy->isVoidTy() ? llvm::Type::getInt8Ty(ctx) : retTy;
+    if (retTy->getScalarType()->isIntegerTy(1))
+        outTy = retTy->isVectorTy()
+            ? (llvm::Type *)llvm::VectorType::get(llvm::Type::getInt8Ty(ctx), retTy->getVectorNumElements())
+            : llvm::Type::getInt8Ty(ctx);
+
+    llvm::Type *params[] = { llvm::PointerType::getUnqual(outTy) };
+    llvm::FunctionType *ft = llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), params, false);
+    llvm::Function *thunk = llvm::Function::Create(ft, llvm::GlobalValue::ExternalLinkage, ThunkName, m);
+    llvm::BasicBlock *bb = llvm::BasicBlock::Create(ctx, "entry", thunk);
+
+    llvm::Value *res = llvm::CallInst::Create(entry, args, "", bb);
+    if (!retTy->isVoidTy()) {
+        if (outTy != retTy)
+            res = new llvm::ZExtInst(res, outTy, "", bb);
+        new llvm::StoreInst(res, &*thunk->arg_begin(), false, 4, bb);
+    }
+    llvm::ReturnInst::Create(ctx, bb);
+}
+
+static void PrintScalar(const char *addr, llvm::Type *ty) {
+    if (ty->isIntegerTy(1))
+        printf("%d", *(const unsigned char *)addr ? -1 : 0);
+    else if (ty->isIntegerTy())
+        printf("%d", *(const int *)addr);
+    else
+        printf("%e", *(const float *)addr);
+}
+
+/* Prints the first lanes components of a vector (a vec3 comes back in
+ * 4 lanes). */
+static void PrintVector(const char *buf, llvm::VectorType *vt, unsigned lanes) {
+    llvm::Type *elem = vt->getElementType();
+    int stride = elem->isIntegerTy(1) ? 1 : 4;
+    for (unsigned i = 0; i < lanes; i++) {
+        if (i > 0) printf(" ");
+        PrintScalar(buf + i * stride, elem);
+    }
+}
+
+/* Prints a scalar or vector result, or a matrix one column after the
+ * other, all on one line. */
+static void PrintResult(const char *buf, llvm::Type *ty, unsigned lanes,
+                        const llvm::DataLayout &layout) {
+    printf("Result: ");
+    if (llvm::ArrayType *at = llvm::dyn_cast<llvm::ArrayType>(ty)) {
+        llvm::VectorType *col = llvm::cast<llvm::VectorType>(at->getElementType());
+        uint64_t stride = layout.getTypeAllocSize(col);
+        for (unsigned j = 0; j < at->getNumElements(); j++) {
+            if (j > 0) printf(" ");
+            PrintVector(buf + j * stride, col, lanes);
+        }
+    }
+    else if (llvm::VectorType *vt = llvm::dyn_cast<llvm::VectorType>(ty))
+        PrintVector(buf, vt, lanes);
+    else
+        PrintScalar(buf, ty);
+    printf("\n");
+}
+
+static double NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Function: Benchmark
+ * -------------------
+ * Calls the thunk calls times per sample and prints the mean ns/call over
+ * BenchSamples samples. An untimed first sample warms up the caches and
+ * branch predictors. The thunk's indirect call is part of every sample;
+ * it costs the same at every optimization level, so comparisons between
+ * levels are unaffected. */
+static void Benchmark(ThunkFn run, char *result, long calls) {
+    for (long i = 0; i < calls; i++)
+        run(result);
+
+    double ns[BenchSamples], mean = 0;
+    for (int s = 0; s < BenchSamples; s++) {
+        double start = NowNs();
+        for (long i = 0; i < calls; i++)
+            run(result);
+        ns[s] = (NowNs() - start) / calls;
+        mean += ns[s];
+    }
+    mean /= BenchSamples;
+
+    double var = 0;
+    for (int s = 0; s < BenchSamples; s++)
+        var += (ns[s] - mean) * (ns[s] - mean);
+    var /= BenchSamples - 1;
+    double ci = BenchT95 * sqrt(var / BenchSamples);
+
+    printf("Bench: %.3f ns/call +- %.3f (95%% CI, %d x %ld calls)\n",
+           mean, ci, BenchSamples, calls);
+}
+
+bool RunModule(llvm::Module *module, const char *datFile, long benchCalls) {
+    vector<DatLine> lines;
+    if (!ReadDatFile(datFile, lines)) {
+        ReportError::Formatted(NULL, "Cannot read run data file %s.", datFile);
+        return false;
+    }
+
+    string funct;
+    vector<DatLine> gins, params;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (lines[i].key == "funct") funct = lines[i].fields[0];
+        else if (lines[i].key == "gin") gins.push_back(lines[i]);
+        else if (lines[i].key == "param") params.push_back(lines[i]);
+    }
+
+    std::unique_ptr<llvm::Module> copy = llvm::CloneModule(module);
+    llvm::Function *entry = copy->getFunction(funct);
+    if (entry == NULL || entry->isDeclaration()) {
+        ReportError::Formatted(NULL, "Entry function '%s' is not defined.", funct.c_str());
+        return false;
+    }
+    if (entry->arg_size() != params.size()) {
+        ReportError::Formatted(NULL, "'%s' takes %d arguments but %s gives %d.", funct.c_str(),
+                               (int)entry->arg_size(), datFile, (int)params.size());
+        return false;
+    }
+
+    vector<llvm::Value*> args;
+    llvm::Function::arg_iterator arg = entry->arg_begin();
+    for (size_t i = 0; i < params.size(); i++, ++arg) {
+        size_t pos = 1;  // fields[0] is the type
+        llvm::Constant *c = ParseConstant(arg->getType(), params[i].fields, pos,
+                                          DatLanes(params[i].fields[0]));
+        if (c == NULL) {
+            ReportError::Formatted(NULL, "Bad value for argument %d of '%s'.", (int)i + 1, funct.c_str());
+            return false;
+        }
+        args.push_back(c);
+    }
+    llvm::Type *retTy = entry->getReturnType();
+    llvm::Type *laneTy = retTy->isArrayTy() ? retTy->getArrayElementType() : retTy;
+    unsigned lanes = laneTy->isVectorTy() ? laneTy->getVectorNumElements() : 1;
+    if (entry->hasFnAttribute(IRGenerator::ResultLanesAttr))
+        lanes = atoi(entry->getFnAttribute(IRGenerator::ResultLanesAttr).getValueAsString().str().c_str());
+    BuildThunk(copy.get(), entry, args);
+
+    // compile for the machine we are running on; MCJIT fills in its layout
+    copy->setTargetTriple(llvm::sys::getProcessTriple());
+    copy->setDataLayout("");
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+
+    string err;
+    llvm::Module *jitModule = copy.get();
+    llvm::ExecutionEngine *ee = llvm::EngineBuilder(std::move(copy))
+        .setErrorStr(&err)
+        .setEngineKind(llvm::EngineKind::JIT)
+        .create();
+    if (ee == NULL) {
+        ReportError::Formatted(NULL, "Cannot create JIT: %s", err.c_str());
+        return false;
+    }
+    ee->finalizeObject();
+
+    bool ok = true;
+    for (size_t i = 0; i < gins.size() && ok; i++) {
+        const string &name = gins[i].fields[0];
+        llvm::GlobalVariable *gv = jitModule->getNamedGlobal(name);
+        char *addr = gv ? (char *)ee->getGlobalValueAddress(name) : NULL;
+        size_t pos = 2;  // fields[0] is the name, fields[1] the type
+        if (addr == NULL) {
+            ReportError::Formatted(NULL, "Global '%s' is not defined.", name.c_str());
+            ok = false;
+        }
+        else if (!StoreValue(addr, gv->getValueType(), gins[i].fields, pos, ee->getDataLayout(),
+                             DatLanes(gins[i].fields.size() > 1 ? gins[i].fields[1] : ""))) {
+            ReportError::Formatted(NULL, "Bad value for global '%s'.", name.c_str());
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        ThunkFn run = (ThunkFn)ee->getFunctionAddress(ThunkName);
+        char result[ResultBytes];
+        memset(result, 0, sizeof(result));
+        run(result);
+        if (!retTy->isVoidTy())
+            PrintResult(result, retTy, lanes, ee->getDataLayout());
+        if (benchCalls > 0)
+            Benchmark(run, result, benchCalls);
+        fflush(stdout);
+    }
+
+    delete ee;
+    return ok;
+}
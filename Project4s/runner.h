@@ -0,0 +1,35 @@
+/**
+ * File: runner.h
+ * --------------
+ * Runs a compiled program in-process for glc --run, in place of writing
+ * bitcode for the external gli interpreter. The module is JIT compiled
+ * with MCJIT, the globals named by "gin:" lines in a test's .dat file are
+ * written straight into JIT memory, the "funct:" entry point is called
+ * with the "param:" arguments, and its value is printed the way the .out
+ * files expect it:
+ *
+ *    Result: 42              int
+ *    Result: 2.500000e+00    float
+ *    Result: -1              bool (true prints -1, false prints 0)
+ *
+ * Vector results print their components separated by spaces, and matrix
+ * results their columns one after the other.
+ *
+ * With --bench N the entry point is then called N times per sample over
+ * several timed samples, and the mean cost is printed after the result:
+ *
+ *    Bench: 3.412 ns/call +- 0.051 (95% CI, 10 x 1000000 calls)
+ */
+
+#ifndef _H_runner
+#define _H_runner
+
+namespace llvm { class Module; }
+
+// Runs the entry point described by datFile. The module itself is left
+// untouched; the JIT works on a copy. Problems with the .dat file or the
+// module are reported through ReportError. Returns true if the entry
+// point ran. With benchCalls > 0 the entry point is also timed.
+bool RunModule(llvm::Module *module, const char *datFile, long benchCalls = 0);
+
+#endif
@@ -3,21 +3,60 @@
  * You should not need to modify this file. It declare a few constants,
  * types, variables,and functions that are used and/or exported by
  * the lex-generated scanner.
+ *
+ * The scanner is reentrant: all of its state hangs off a yyscan_t made by
+ * CreateScanner(), so several can run at once on different threads.
  */
 
 #ifndef _H_scanner
 #define _H_scanner
 
 #include <stdio.h>
+#include <string>
+#include <vector>
+#include "location.h"
+#include "source.h"
 
 #define MaxIdentLen 31    // Maximum length for identifiers
 
-extern char *yytext;      // Text of lexeme just scanned
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;   // same definition as in the generated lex.yy.c
+#endif
+
+/* Struct: ScannerState
+ * --------------------
+ * What the scanner keeps between calls to yylex for one input (its
+ * yyextra): the current position and the source being read, where error
+ * messages find the offending line.
+ */
+struct ScannerState {
+    int curLineNum, curColNum;
+    SourceBuffer *source;
+    std::string line;     // the last line handed out by GetLineNumbered
+    yyltype lastLoc;      // location of the last token scanned
 
+    ScannerState() : curLineNum(1), curColNum(1), source(NULL) {}
+};
+
+yyscan_t CreateScanner(SourceBuffer *source, ScannerState *state); // Defined in scanner.l
+void DestroyScanner(yyscan_t scanner);                    // ditto
+
+/* Struct: ScannedToken
+ * ---------------------
+ * A token code and its spelling, as returned by ScanTokens().
+ */
+struct ScannedToken {
+    int code;
+    std::string text;
+};
 
-int yylex();              // Defined in the generated lex.yy.c file
+// Scans input to the end and appends every token to tokens, skipping
+// whitespace and comments; the compile cache hashes these as the
+// normalized program. Returns false if there were lexical errors.
+bool ScanTokens(SourceBuffer *source, std::vector<ScannedToken> &tokens); // ditto
 
-void InitScanner();                 // Defined in scanner.l user subroutines
-const char *GetLineNumbered(int n); // ditto
+// Line n of the input being compiled on this thread, or NULL
+const char *GetLineNumbered(int n);                       // ditto
  
 #endif
@@ -0,0 +1,93 @@
+/* File: source.cc
+ * ---------------
+ * Implementation of the in-memory program text.
+ */
+
+#include "source.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// flex's end-of-buffer marker is two NULs
+static const size_t Padding = 2;
+
+SourceBuffer::SourceBuffer() : text(NULL), length(0), mapped(0) {
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (mapped)
+        munmap(text, mapped);
+    else
+        free(text);
+}
+
+bool SourceBuffer::Map(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // not a regular file; fall back to reading it
+        FILE *fp = fdopen(fd, "r");
+        bool ok = fp != NULL && Read(fp);
+        if (fp) fclose(fp); else close(fd);
+        return ok;
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = st.st_size;
+    size_t total = (size + Padding + page - 1) / page * page;
+
+    // Reserve zeroed pages for the text plus padding, then map the file
+    // over the front of them; whatever follows the file reads as NULs.
+    void *base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    if (size > 0 && mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, total);
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    text = (char *)base;
+    length = size;
+    mapped = total;
+    return true;
+}
+
+bool SourceBuffer::Read(FILE *fp) {
+    size_t capacity = 64 * 1024;
+    text = (char *)malloc(capacity);
+    length = 0;
+    size_t n;
+    while (text != NULL && (n = fread(text + length, 1, capacity - length - Padding, fp)) > 0) {
+        length += n;
+        if (capacity - length - Padding == 0)
+            text = (char *)realloc(text, capacity *= 2);
+    }
+    if (text == NULL)
+        return false;
+    memset(text + length, 0, Padding);
+    return !ferror(fp);
+}
+
+const char *SourceBuffer::Line(int n, size_t *len) {
+    if (lineStarts.empty()) {
+        lineStarts.push_back(0);
+        for (const char *p = text; (p = (const char *)memchr(p, '\n', text + length - p)) != NULL; p++)
+            lineStarts.push_back(p + 1 - text);
+    }
+    if (n < 1 || n > (int)lineStarts.size())
+        return NULL;
+
+    size_t start = lineStarts[n - 1];
+    size_t end = (n < (int)lineStarts.size()) ? lineStarts[n] - 1 : length;
+    *len = end - start;
+    return text + start;
+}
@@ -0,0 +1,53 @@
+/**
+ * File: source.h
+ * --------------
+ * The text of one program, held in memory for the scanner to read in
+ * place. A file is mmap'ed rather than read; a stream such as stdin is
+ * read in once. Either way the scanner works straight out of this buffer
+ * (flex's yy_scan_buffer), so the source is not copied again into flex's
+ * own input buffer or line by line for error messages.
+ *
+ * Error messages find their lines through an index of line start
+ * offsets, built the first time a line is asked for; a program that
+ * compiles cleanly never builds it.
+ *
+ * flex needs a writable buffer ending in two NUL bytes. The file is
+ * mapped privately with those bytes past its end, and flex's brief
+ * writes (it NUL-terminates each token while an action runs) touch the
+ * process's copy-on-write pages only, never the file.
+ */
+
+#ifndef _H_source
+#define _H_source
+
+#include <stdio.h>
+#include <stddef.h>
+#include <vector>
+
+class SourceBuffer {
+  public:
+    SourceBuffer();
+    ~SourceBuffer();
+
+    // Maps the file at path. Returns false if it cannot be opened.
+    bool Map(const char *path);
+
+    // Reads fp to the end. Returns false on a read error.
+    bool Read(FILE *fp);
+
+    // The text and its length, not counting the two NULs after it.
+    char *Text() const { return text; }
+    size_t Length() const { return length; }
+
+    // Line n (from 1) and its length without the newline, or NULL if the
+    // program has fewer lines.
+    const char *Line(int n, size_t *len);
+
+  private:
+    char *text;
+    size_t length;
+    size_t mapped;        // bytes mapped, or 0 if text is from malloc
+    std::vector<size_t> lineStarts;
+};
+
+#endif
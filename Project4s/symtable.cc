@@ -3,62 +3,77 @@
  *
  */
 
+#include <algorithm>
 #include "symtable.h"
 #include "ast.h"
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "timing.h"
 const int  P = 1;
 
 SymbolTable::SymbolTable() {
-    scopeVector = new vector<map<string, values>*>();
     current = 0;
+    heads.reserve(256);
+    bindings.reserve(256);
+    scopeMarks.reserve(64);
 }
 
 void SymbolTable::pop() {
-    scopeVector->pop_back();
+    int mark = scopeMarks.back();
+    scopeMarks.pop_back();
+    while ((int)bindings.size() > mark) {
+        Binding &b = bindings.back();
+        heads[b.sym] = b.shadowed;
+        bindings.pop_back();
+    }
     current = current - P;
 }
 void SymbolTable::push() {
-    scopeVector->push_back(new map<string,values>());
+    scopeMarks.push_back(bindings.size());
     current = current + P;
 }
 
+int *SymbolTable::Head(Symbol s) {
+    if (s < 0)
+        return NULL;
+    if (s >= (int)heads.size())
+        heads.resize(max(s + P, Interner::NumSymbols()), -P);
+    return &heads[s];
+}
 
-void SymbolTable::addSym(pair<string, values> s) {
+void SymbolTable::addSym(pair<Symbol, values> s) {
     
     int curr = current - P;
     if (lookupValue( curr, s.first).flag != -P)
         return;
-    scopeVector->at(current - P)->insert(s);
+    int *head = Head(s.first);
+    if (head == NULL)
+        return;
+    Binding b = { s.first, curr, *head, s.second };
+    *head = bindings.size();
+    bindings.push_back(b);
 }
 
-values SymbolTable::lookupValue( int x, string s) {
-    map<string, values> *currMap = scopeVector->at(x);
-    map<string, values>::iterator it;
-    it = currMap->find(s);
-
-    if (it != currMap->end()) {
-        return it->second;
+values SymbolTable::lookupValue( int x, Symbol s) {
+    Timing::Count(Timing::SymbolLookups);
+    if (s >= 0 && s < (int)heads.size()) {
+        int i = heads[s];
+        // Only bindings from scopes deeper than x can sit in front of it.
+        while (i >= 0 && bindings[i].scope > x)
+            i = bindings[i].shadowed;
+        if (i >= 0 && bindings[i].scope == x)
+            return bindings[i].val;
     }
 
     values none = { -P, NULL, NULL };
     return none;
 }
 
-values SymbolTable::lookupValue(string s) {
-   int i = current - P;
-    while ( i >= 0) {
-        values in = lookupValue( i,s);
-
-        if (in.flag != -P) {
-            return in;
-        }
-	i= i - P;
-
-    }
+values SymbolTable::lookupValue(Symbol s) {
+    Timing::Count(Timing::SymbolLookups);
+    if (s >= 0 && s < (int)heads.size() && heads[s] >= 0)
+        return bindings[heads[s]].val;
     
     values none = {-P, NULL, NULL};
     return none;
 }
-
-
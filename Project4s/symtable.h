@@ -2,12 +2,17 @@
  * File: symtable.h
  * ----------- 
  *  Header file for Symbol table implementation.
+ *
+ *  Bindings are kept as shadow chains: every Symbol has a head slot that
+ *  points at its innermost live binding, and each binding remembers the
+ *  one it shadows. A lookup is a single array index. Scopes are marks
+ *  into the binding log, so pop() just unwinds the log back to the mark,
+ *  restoring each head it passes. Nothing is allocated per scope.
  */
 
 #ifndef SYM_H_
 #define SYM_H_
 
-#include <map>
 #include <vector>
 #include "ast.h"
 #include "ast_decl.h"
@@ -30,11 +35,23 @@ class SymbolTable  {
         void pop();
         int current;
         void push();
-        void addSym(pair<string, values>);
-        vector<map<string, values>*> *scopeVector;
-        values lookupValue(int x, string s);
-        values lookupValue(string s);
-       
+        void addSym(pair<Symbol, values>);
+        values lookupValue(int x, Symbol s);
+        values lookupValue(Symbol s);
+
+    private:
+        struct Binding {
+            Symbol sym;
+            int scope;          // index of the scope that declared it
+            int shadowed;       // previous binding of sym, or -1
+            values val;
+        };
+
+        int *Head(Symbol s);
+
+        vector<int> heads;        // innermost binding per Symbol, or -1
+        vector<Binding> bindings; // every live binding, in declaration order
+        vector<int> scopeMarks;   // bindings.size() at each push()
 };
 
 #endif
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 set -bm
-trap 'if [[ $? -eq 139 ]]; then echo "segfault $testbasename!" >> $testbasename.out; fi' CHLD
+trap 'if [[ $? -eq 139 ]]; then echo "segfault $testbasename!" >> $testbasename.myout; fi' CHLD
 
 if (! [ -d tests ]); then
         echo "public_samples folder not found. Creating one for you"
@@ -21,13 +21,6 @@ echo "Compiling Done"
 if cd tests; then
 	cp ../glc ./
         chmod +x ./glc
-
-	if (! [ -f ../gli ]); then 
-		echo "gli is not present"
-		exit 1
-	fi 	
-	cp ../gli ./
-	chmod +x ./gli	
 else 
 	echo "Could not change diretcory to samples ..Quiting 	"
 	exit 1
@@ -40,9 +33,7 @@ if [ -f glc ]; then
                 testbasename=${testid%.glsl}
                 rm -rf "$testbasename".ll
 		rm -rf "$testbasename".bc
-                ./glc <$testname > $testbasename.bc
-		llvm-dis $testbasename.bc
-                ./gli $testbasename.bc > $testbasename.myout
+                ./glc --run $testbasename.dat <$testname > $testbasename.myout 2>/dev/null
         done
 
         for testname in $PWD/*.out
@@ -51,14 +42,13 @@ if [ -f glc ]; then
                 testbasename=${testid%.out}
                 if cmp -s "$testbasename.myout" "$testbasename.out"
                 then
-                        echo "$testbasename Passed..Cleaning debug files for this test"
-			rm $testbasename.ll
-			rm $testbasename.bc
+                        echo "$testbasename Passed"
                 else
-                        echo "$testbasename Failed"
+                        echo "$testbasename Failed..Writing $testbasename.ll for debugging"
+                        ./glc <$testbasename.glsl > $testbasename.bc 2>/dev/null
+                        llvm-dis $testbasename.bc
                 fi
         done
-	rm -rf gli
 	rm -rf glc	
 else
         echo "Code did not compile"
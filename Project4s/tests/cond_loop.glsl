@@ -0,0 +1,20 @@
+int n;
+int m;
+int k;
+
+int condloop()
+{
+   int i;
+   int c;
+   int s;
+
+   c = 0;
+   s = 0;
+   for (i = 0; i < n && i / 2 < m; i++) {
+      if (i > 3 || (c = c + 1) > 100) {
+         s = s + (i > 5 ? i / k : 1);
+      }
+   }
+
+   return s * 100 + c;
+}
@@ -0,0 +1,26 @@
+int x;
+int y;
+
+int shortcirc()
+{
+   int n;
+   int r;
+   bool b;
+
+   n = 0;
+   b = x > 5 && (n = n + 1) > 0;
+   if (b) {
+      r = 100;
+   }
+   else {
+      r = 0;
+   }
+
+   b = y > 0 || (n = n + 10) > 0;
+   r = r + n;
+
+   r = r + 100 * (x > 1 ? x * y + x * 2 + y - 1 : (n = 0));
+   r = r + (x < y ? 1 : 2);
+
+   return r;
+}
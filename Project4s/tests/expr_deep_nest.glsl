@@ -0,0 +1,8 @@
+int a;
+
+int deepnest()
+{
+   int r;
+   r = ((((((((((((((((((((((((a + 1) * 1) - 3) + 4) * 1) - 6) + 7) * 1) - 9) + 10) * 1) - 12) + 13) * 1) - 15) + 16) * 1) - 18) + 19) * 1) - 21) + 22) * 1) - 24);
+   return r;
+}
@@ -0,0 +1,28 @@
+int x;
+float f;
+
+int foldconst()
+{
+   int r;
+   float g;
+
+   r = x * 1 + 0 + (2 + 3) * 4 - 10 / (7 - 2);
+   g = f * 1.0 + 0.5 * 2.0;
+
+   if (3 > 4) {
+      r = 0;
+   }
+   else {
+      r = r + 1;
+   }
+
+   while (1 == 2) {
+      r = r - 100;
+   }
+
+   if (true && g > 0.0) {
+      r = r * 2;
+   }
+
+   return r;
+}
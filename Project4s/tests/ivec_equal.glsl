@@ -0,0 +1,11 @@
+ivec4 p;
+ivec4 q;
+
+bool ivecequal()
+{
+   ivec4 d;
+
+   d = p * 2;
+
+   return d == q;
+}
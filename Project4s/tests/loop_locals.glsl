@@ -0,0 +1,23 @@
+int n;
+
+int looplocals()
+{
+   int i;
+   int acc;
+
+   acc = 0;
+   for (i = 0; i < n; i++) {
+      int t;
+      int d;
+      float u;
+      vec4 pad;
+
+      t = i * 2;
+      d = t - i - i;
+      u = 0.5;
+      pad.x = u;
+      acc = acc + d + 1;
+   }
+
+   return acc;
+}
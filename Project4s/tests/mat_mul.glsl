@@ -0,0 +1,11 @@
+mat3 a;
+mat3 b;
+
+mat3 matmul()
+{
+   mat3 c;
+
+   c = a * b - a;
+
+   return c;
+}
@@ -0,0 +1,7 @@
+mat2 m;
+vec2 v;
+
+vec2 matvec()
+{
+   return m * v;
+}
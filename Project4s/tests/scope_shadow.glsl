@@ -0,0 +1,19 @@
+
+int x;
+
+int shadow(int y)
+{
+   int r;
+   r = x;
+   if ( y > 0 ) {
+      int x;
+      x = y * 10;
+      r = r + x;
+   }
+   {
+      int y;
+      y = 100;
+      r = r + y;
+   }
+   return r + x + y;
+}
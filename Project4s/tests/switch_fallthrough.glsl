@@ -0,0 +1,26 @@
+int x;
+
+int switchfall()
+{
+   int r;
+   r = 0;
+
+   switch (x) {
+      case 0:
+         r = r + 1;
+         break;
+      case 1:
+      case 2:
+         r = r + 10;
+      case 3:
+         r = r + 100;
+         break;
+      case 4 - 8:
+         r = 7;
+         break;
+      default:
+         r = r + 1000;
+   }
+
+   return r;
+}
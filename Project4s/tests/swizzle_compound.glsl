@@ -0,0 +1,14 @@
+vec4 c;
+vec3 n;
+
+vec4 swizzlecompound()
+{
+   vec4 t;
+
+   t = c;
+   t.zx += n.xy;
+   t.w *= 2.0;
+   t.yz = t.zy;
+
+   return t.wzyx;
+}
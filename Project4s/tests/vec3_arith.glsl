@@ -0,0 +1,13 @@
+vec3 a;
+vec3 b;
+float s;
+
+vec3 vec3arith()
+{
+   vec3 t;
+
+   t = a * s + b;
+   t -= 1.0;
+
+   return t;
+}
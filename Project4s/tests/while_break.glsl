@@ -0,0 +1,23 @@
+int n;
+int m;
+
+int whilebreak()
+{
+   int i;
+   int s;
+
+   i = 0;
+   s = 0;
+   while (i < n && i * i < m) {
+      i++;
+      if (i == 3) {
+         continue;
+      }
+      if (s > 20) {
+         break;
+      }
+      s = s + i;
+   }
+
+   return s * 100 + i;
+}
@@ -0,0 +1,63 @@
+/* File: threadpool.cc
+ * -------------------
+ * Implementation of the work-stealing pool.
+ */
+
+#include "threadpool.h"
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(int numWorkers) {
+    if (numWorkers < 1) numWorkers = 1;
+    for (int i = 0; i < numWorkers; i++)
+        queues.push_back(new Queue());
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    for (size_t i = 0; i < queues.size(); i++)
+        delete queues[i];
+}
+
+/* Takes the next task off the worker's own deque, or failing that steals
+ * the last one from the first other worker that still has any. */
+bool WorkStealingPool::Take(int worker, int &task) {
+    int n = queues.size();
+    for (int k = 0; k < n; k++) {
+        int victim = (worker + k) % n;
+        Queue *q = queues[victim];
+        std::lock_guard<std::mutex> guard(q->lock);
+        if (q->tasks.empty())
+            continue;
+        if (victim == worker) {
+            task = q->tasks.front();
+            q->tasks.pop_front();
+        } else {
+            task = q->tasks.back();
+            q->tasks.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::Work(int worker, const std::function<void(int)> &task) {
+    int t;
+    while (Take(worker, t))
+        task(t);
+}
+
+void WorkStealingPool::Run(int numTasks, const std::function<void(int)> &task) {
+    int n = queues.size();
+    // deal contiguous runs so neighbouring inputs stay on one worker
+    for (int w = 0; w < n; w++) {
+        std::lock_guard<std::mutex> guard(queues[w]->lock);
+        for (int i = numTasks * w / n; i < numTasks * (w + 1) / n; i++)
+            queues[w]->tasks.push_back(i);
+    }
+
+    std::vector<std::thread> threads;
+    for (int w = 1; w < n; w++)
+        threads.push_back(std::thread(&WorkStealingPool::Work, this, w, std::cref(task)));
+    Work(0, task);
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
@@ -0,0 +1,47 @@
+/**
+ * File: threadpool.h
+ * ------------------
+ * A small work-stealing pool for running a fixed batch of independent
+ * tasks, used by glc -j to compile many shaders at once.
+ *
+ * The tasks 0..n-1 are dealt out up front as contiguous runs, one deque
+ * per worker. A worker takes tasks from the front of its own deque; when
+ * that runs dry it steals from the back of another worker's, so a worker
+ * that drew a run of large shaders is relieved by the others rather than
+ * holding up the end of the batch. Tasks never add more tasks, so a
+ * worker that finds every deque empty is done.
+ */
+
+#ifndef _H_threadpool
+#define _H_threadpool
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class WorkStealingPool {
+  public:
+    WorkStealingPool(int numWorkers);
+    ~WorkStealingPool();
+
+    // Calls task(i) for every i in [0, numTasks) across the workers (the
+    // calling thread is one of them) and returns once all have finished.
+    // The order tasks run in is unspecified.
+    void Run(int numTasks, const std::function<void(int)> &task);
+
+    int NumWorkers() const { return queues.size(); }
+
+  private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<int> tasks;
+    };
+
+    bool Take(int worker, int &task);
+    void Work(int worker, const std::function<void(int)> &task);
+
+    std::vector<Queue*> queues;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/* File: timing.cc
+ * ---------------
+ * Implementation of the phase timing report.
+ */
+
+#include "timing.h"
+#include "utility.h"
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace std;
+
+bool Timing::enabled = false;
+
+struct PhaseTotals {
+    const char *name;
+    int calls;
+    double wall, cpu;   // milliseconds
+    long rss;           // kilobytes
+};
+
+static mutex phasesLock;                // guards phases
+static vector<PhaseTotals> phases;
+static atomic<long> counters[Timing::NumCounters];
+static thread_local Timing::Phase *innermost = NULL;
+static double processStart;
+
+// The report lists phases in the order a compile goes through them.
+static const char *PhaseOrder[] = {
+    "cache", "parse", "check", "fold", "emit", "optimize", "link", "dump", "write"
+};
+
+static int Rank(const PhaseTotals &p) {
+    int n = sizeof(PhaseOrder) / sizeof(PhaseOrder[0]);
+    for (int i = 0; i < n; i++)
+        if (!strcmp(p.name, PhaseOrder[i]))
+            return i;
+    return n;
+}
+
+static bool InOrder(const PhaseTotals &a, const PhaseTotals &b) {
+    return Rank(a) < Rank(b);
+}
+
+static const char *CounterNames[Timing::NumCounters] = {
+    "ast_nodes", "symbol_lookups", "instructions_emitted", "instructions", "basic_blocks"
+};
+
+static double WallMs() {
+    return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double CpuMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static long PeakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void Timing::Init() {
+    enabled = IsDebugOn("timing") || GetTimingJsonFile() != NULL;
+    processStart = WallMs();
+}
+
+void Timing::Add(Counter c, long n) {
+    counters[c].fetch_add(n, memory_order_relaxed);
+}
+
+Timing::Phase::Phase(const char *n) : name(n), active(enabled) {
+    if (!active)
+        return;
+    wall = WallMs();
+    cpu = CpuMs();
+    rss = PeakRssKb();
+    childWall = childCpu = 0;
+    childRss = 0;
+    outer = innermost;
+    innermost = this;
+}
+
+Timing::Phase::~Phase() {
+    if (!active)
+        return;
+    double w = WallMs() - wall, c = CpuMs() - cpu;
+    long r = PeakRssKb() - rss;
+    innermost = outer;
+    if (outer != NULL) {
+        outer->childWall += w;
+        outer->childCpu += c;
+        outer->childRss += r;
+    }
+
+    lock_guard<mutex> guard(phasesLock);
+    size_t i = 0;
+    while (i < phases.size() && strcmp(phases[i].name, name) != 0)
+        i++;
+    if (i == phases.size()) {
+        PhaseTotals t = { name, 0, 0, 0, 0 };
+        phases.push_back(t);
+    }
+    phases[i].calls++;
+    phases[i].wall += w - childWall;
+    phases[i].cpu += c - childCpu;
+    phases[i].rss += r - childRss;
+}
+
+static void WriteJson(FILE *fp, double total) {
+    fprintf(fp, "{\n  \"wall_ms\": %.3f,\n  \"peak_rss_kb\": %ld,\n  \"phases\": [\n", total, PeakRssKb());
+    for (size_t i = 0; i < phases.size(); i++)
+        fprintf(fp, "    {\"name\": \"%s\", \"calls\": %d, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"rss_kb\": %ld}%s\n",
+                phases[i].name, phases[i].calls, phases[i].wall, phases[i].cpu, phases[i].rss,
+                i + 1 < phases.size() ? "," : "");
+    fprintf(fp, "  ],\n  \"counts\": {");
+    for (int c = 0; c < Timing::NumCounters; c++)
+        fprintf(fp, "%s\"%s\": %ld", c ? ", " : "", CounterNames[c], counters[c].load());
+    fprintf(fp, "}\n}\n");
+}
+
+void Timing::Report() {
+    if (!enabled)
+        return;
+    lock_guard<mutex> guard(phasesLock);
+    double total = WallMs() - processStart;
+    stable_sort(phases.begin(), phases.end(), InOrder);
+
+    if (IsDebugOn("timing")) {
+        fprintf(stderr, "===== glc timing report =====\n");
+        fprintf(stderr, "%-10s %6s %12s %12s %12s\n", "phase", "calls", "wall ms", "cpu ms", "rss +KB");
+        for (size_t i = 0; i < phases.size(); i++)
+            fprintf(stderr, "%-10s %6d %12.3f %12.3f %12ld\n", phases[i].name, phases[i].calls,
+                    phases[i].wall, phases[i].cpu, phases[i].rss);
+        fprintf(stderr, "%-10s %6s %12.3f %12s %12ld peak\n", "total", "", total, "", PeakRssKb());
+        for (int c = 0; c < NumCounters; c++)
+            fprintf(stderr, "%-22s %ld\n", CounterNames[c], counters[c].load());
+    }
+
+    if (const char *path = GetTimingJsonFile()) {
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "Cannot write timing report %s\n", path);
+            return;
+        }
+        WriteJson(fp, total);
+        fclose(fp);
+    }
+}
@@ -0,0 +1,64 @@
+/**
+ * File: timing.h
+ * --------------
+ * The -d timing report (and its JSON twin, --timing-json <file>): wall
+ * time, CPU time and peak RSS growth for each phase of a compile, along
+ * with a few counts of the work done.
+ *
+ * A phase is timed by declaring a Timing::Phase for its extent:
+ *
+ *    { Timing::Phase phase("check"); ...; }
+ *
+ * Phases nest (Program::Check runs inside yyparse, for instance) and
+ * time spent in an inner phase is not counted again in the outer one,
+ * so the rows add up. CPU time is the calling thread's own, so under -j
+ * each phase's CPU column sums the work of every thread while its wall
+ * column sums the time each thread spent in it. RSS growth is measured
+ * against the process's peak, which only ever rises.
+ *
+ * When no report was asked for, Phase and Count cost one test of a flag.
+ */
+
+#ifndef _H_timing
+#define _H_timing
+
+#include <stdio.h>
+
+class Timing {
+  public:
+    enum Counter { AstNodes, SymbolLookups, InstructionsEmitted,
+                   Instructions, BasicBlocks, NumCounters };
+
+    class Phase {
+      public:
+        Phase(const char *name);
+        ~Phase();
+
+      private:
+        const char *name;
+        bool active;
+        double wall, cpu;     // when the phase began
+        long rss;
+        double childWall, childCpu;
+        long childRss;
+        Phase *outer;
+    };
+
+    // Turns the report on if -d timing or --timing-json asked for it.
+    static void Init();
+    static bool Enabled() { return enabled; }
+
+    static void Count(Counter c, long n = 1) {
+        if (enabled) Add(c, n);
+    }
+
+    // Prints the report to stderr for -d timing and writes the JSON file
+    // for --timing-json. Call once, when the compiles are done.
+    static void Report();
+
+  private:
+    static void Add(Counter c, long n);
+    static bool enabled;
+};
+
+#endif
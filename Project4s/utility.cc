@@ -11,6 +11,14 @@
 using std::vector;
 
 static vector<const char*> debugKeys;
+static int optLevel = 0;
+static int numJobs = 1;
+static const char *cacheDir = NULL;
+static unsigned long long cacheSize = 256ULL << 20;
+static const char *timingJsonFile = NULL;
+static const char *runDataFile = NULL;
+static long benchCalls = 0;
+static vector<const char*> inputFiles;
 static const int BufferSize = 2048;
 
 void Failure(const char *format, ...) {
@@ -58,19 +66,120 @@ void PrintDebug(const char *key, const char *format, ...) {
   printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
 }
 
+int GetOptimizationLevel() {
+  return optLevel;
+}
+
+int GetNumJobs() {
+  return numJobs;
+}
+
+const char *GetCacheDir() {
+  return cacheDir;
+}
+
+unsigned long long GetCacheSize() {
+  return cacheSize;
+}
+
+const char *GetTimingJsonFile() {
+  return timingJsonFile;
+}
+
+const char *GetRunDataFile() {
+  return runDataFile;
+}
+
+long GetBenchCalls() {
+  return benchCalls;
+}
+
+int NumInputFiles() {
+  return inputFiles.size();
+}
+
+const char *GetInputFile(int i) {
+  return inputFiles[i];
+}
+
+static void ReadManifest(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL)
+    Failure("Cannot open manifest %s", path);
+
+  char line[BufferSize];
+  while (fgets(line, sizeof(line), fp)) {
+    char *end = line + strlen(line);
+    while (end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' '))
+      *--end = '\0';
+    if (line[0] != '\0' && line[0] != '#')
+      inputFiles.push_back(strdup(line));
+  }
+  fclose(fp);
+}
+
+static bool IsOptLevelArg(const char *arg) {
+  return strlen(arg) == 3 && !strncmp(arg, "-O", 2) && arg[2] >= '0' && arg[2] <= '3';
+}
+
+// Accepts "N" for -j N; the count must be a positive number.
+static bool ParseJobs(const char *arg) {
+  char *end;
+  long n = strtol(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0' || n < 1)
+    return false;
+  numJobs = n;
+  return true;
+}
+
 void ParseCommandLine(int argc, char *argv[]) {
-  if (argc == 1)
-    return;
-  
-  if (strcmp(argv[1], "-d") != 0) { // first arg is not -d
-    printf("Incorrect Use:   ");
-    for (int i = 1; i < argc; i++) printf("%s ", argv[i]);
-    printf("\n");
-    printf("Correct Usage:   -d <debug-key-1> <debug-key-2> ... \n");
-    exit(2);
+  bool sawDebug = false;
+
+  cacheDir = getenv("GLC_CACHE_DIR");
+  if (cacheDir != NULL && cacheDir[0] == '\0')
+    cacheDir = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (IsOptLevelArg(argv[i]))
+      optLevel = argv[i][2] - '0';
+    else if (!strcmp(argv[i], "-j") && i + 1 < argc && ParseJobs(argv[i + 1]))
+      i++;
+    else if (!strncmp(argv[i], "-j", 2) && argv[i][2] != '\0' && ParseJobs(argv[i] + 2))
+      continue;
+    else if (!strcmp(argv[i], "--run") && i + 1 < argc)
+      runDataFile = argv[++i];
+    else if (!strcmp(argv[i], "--bench") && i + 1 < argc && atol(argv[i + 1]) > 0)
+      benchCalls = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--cache-dir") && i + 1 < argc)
+      cacheDir = argv[++i];
+    else if (!strcmp(argv[i], "--cache-size") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+      cacheSize = (unsigned long long)atoi(argv[++i]) << 20;
+    else if (!strcmp(argv[i], "--timing-json") && i + 1 < argc)
+      timingJsonFile = argv[++i];
+    else if (!strcmp(argv[i], "--manifest") && i + 1 < argc)
+      ReadManifest(argv[++i]);
+    else if (!strcmp(argv[i], "-d"))
+      sawDebug = true;
+    else if (sawDebug)
+      SetDebugForKey(argv[i], true);
+    else if (argv[i][0] != '-')
+      inputFiles.push_back(argv[i]);
+    else {
+      printf("Incorrect Use:   ");
+      for (int j = 1; j < argc; j++) printf("%s ", argv[j]);
+      printf("\n");
+      printf("Correct Usage:   [-O0|-O1|-O2|-O3] [-j <jobs>] [--run <file.dat> [--bench <calls>]] [--cache-dir <dir>] [--cache-size <MB>] [--timing-json <file>] [--manifest <list>] [file.glsl ...] [-d <debug-key-1> <debug-key-2> ...] \n");
+      exit(2);
+    }
   }
 
-  for (int i = 2; i < argc; i++)
-    SetDebugForKey(argv[i], true);
+  if (runDataFile != NULL && !inputFiles.empty()) {
+    printf("--run compiles from stdin and cannot be combined with input files\n");
+    exit(2);
+  }
+  if (benchCalls > 0 && runDataFile == NULL) {
+    printf("--bench times the entry point of --run and needs a .dat file\n");
+    exit(2);
+  }
 }
 
@@ -73,12 +73,88 @@ void SetDebugForKey(const char *key, bool val);
 
 bool IsDebugOn(const char *key);
 
+/**
+ * Function: GetOptimizationLevel()
+ * Usage: if (GetOptimizationLevel() >= 2) ...
+ * -------------------------------------------
+ * Returns the optimization level picked with -O0 .. -O3 on the command
+ * line, or 0 if none was given.
+ */
+
+int GetOptimizationLevel();
+
+/**
+ * Function: GetRunDataFile()
+ * Usage: if (const char *dat = GetRunDataFile()) ...
+ * --------------------------------------------------
+ * Returns the .dat file given with --run, or NULL when glc should write
+ * bitcode instead of running the program.
+ */
+
+const char *GetRunDataFile();
+
+/**
+ * Function: GetBenchCalls()
+ * Usage: if (long calls = GetBenchCalls()) ...
+ * --------------------------------------------
+ * Returns the number of calls per timing sample given with --bench, or 0
+ * when --run should just call the entry point once.
+ */
+
+long GetBenchCalls();
+
+/**
+ * Function: GetNumJobs()
+ * Usage: WorkStealingPool pool(GetNumJobs());
+ * -------------------------------------------
+ * Returns the number of compiler threads asked for with -j N, or 1 if
+ * none was given.
+ */
+
+int GetNumJobs();
+
+/**
+ * Function: GetCacheDir(), GetCacheSize()
+ * Usage: if (const char *dir = GetCacheDir()) ...
+ * -----------------------------------------------
+ * The compile cache directory given with --cache-dir (or the
+ * GLC_CACHE_DIR environment variable), or NULL if caching is off, and
+ * its size bound in bytes (--cache-size, in megabytes; 256 by default).
+ */
+
+const char *GetCacheDir();
+unsigned long long GetCacheSize();
+
+/**
+ * Function: GetTimingJsonFile()
+ * Usage: if (const char *path = GetTimingJsonFile()) ...
+ * ------------------------------------------------------
+ * The file given with --timing-json, where the phase timing report is
+ * written as JSON, or NULL.
+ */
+
+const char *GetTimingJsonFile();
+
+/**
+ * Function: NumInputFiles(), GetInputFile()
+ * Usage: for (int i = 0; i < NumInputFiles(); i++) ... GetInputFile(i)
+ * ---------------------------------------------------------------------
+ * The source files named on the command line, directly or through a
+ * --manifest file listing one path per line. When there are none glc
+ * compiles a single program from stdin.
+ */
+
+int NumInputFiles();
+const char *GetInputFile(int i);
+
 /**
  * Function: ParseCommandLine
  * --------------------------
- * Turn on the debugging flags from the command line.  Verifies that
- * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * Reads the optimization level (-O0 .. -O3), job count (-j N), --run file
+ * and --bench count, cache options and input files and turns on the
+ * debugging flags from the command line.  Every argument
+ * after -d is taken as a debug key to turn on; other arguments that do not
+ * start with '-' are input files.  --run only works on stdin.
  */
 
 void ParseCommandLine(int argc, char *argv[]);